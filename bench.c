@@ -0,0 +1,604 @@
+/*
+ * bench.c - benchmark and regression suite for trans.c. every function
+ *     registerFunctions() registers is run over a list of shapes (powers of
+ *     two, primes, skinny, the lab's 61x67) and gets one CSV (or JSON) row
+ *     per shape and cache geometry: is_transpose() correctness, simulated
+ *     hits, misses and evictions, and the best wall-clock time with its
+ *     throughput (A read plus B written).
+ *
+ * misses come from csim's engine, with no valgrind: A and B live in pages
+ * mapped PROT_NONE while the function runs, so every load and store of them
+ * faults. the SIGSEGV handler records the address, opens the page and sets
+ * the trap flag; after that one instruction, SIGTRAP closes the page again.
+ * the recorded addresses are then replayed into every -c geometry. like
+ * tracegen, A and B are 256x256 ints back to back, so only shapes up to
+ * 256x256 are traced; larger ones are only timed. tracing needs x86-64
+ * linux (the trap flag), elsewhere the miss columns are left empty.
+ * functions run single-threaded while traced (TRANS_THREADS=1 around the
+ * traced call only), and are timed with whatever TRANS_THREADS says, one
+ * thread per cpu by default.
+ *
+ * -B compares against the CSV of an earlier run and exits 1 if any row
+ * lost correctness or misses more than it did, so a commit that makes a
+ * transpose worse fails. times are too noisy to compare that way. kernels
+ * the driver can't call directly are checked too, and a failure exits 1
+ * with or without -B: transpose_square_in_place on every square shape,
+ * and transpose_strided on random shapes of every element width, with
+ * and without padded leading dimensions.
+ *
+ * build:  gcc -O2 -std=c99 -DCSIM_NO_MAIN -o bench bench.c trans.c csim.c cachelab.c -lm -lpthread
+ * run:    ./bench -o base.csv; (change trans.c, rebuild) ./bench -B base.csv
+ *
+ * Author: Iris Yuan
+ */
+#define _GNU_SOURCE /* for REG_EFL, clock_gettime and MAP_ANONYMOUS under -std=c99 */
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <string.h>
+#include <strings.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__x86_64__) && defined(__linux__)
+#include <ucontext.h>
+#define BENCH_TRACE 1
+#endif
+#include "cachelab.h"
+#include "csim.h"
+
+/* from cachelab.c, filled in by registerFunctions() */
+extern trans_func_t func_list[MAX_TRANS_FUNCS];
+extern int func_counter;
+
+void registerFunctions(void);
+int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+
+/* from trans.c, not registered: checked on their own below */
+void transpose_square_in_place(int N, int A[N][N]);
+int is_transpose_in_place(int N, int A[N][N], int before[N][N]);
+int transpose_strided(const void *src, long src_ld, void *dst, long dst_ld, int rows, int cols, int elem_size);
+
+#define TRACE_MAX_DIM 256    /* tracegen's A and B */
+#define TRACE_MATRIX_BYTES (sizeof(int) * TRACE_MAX_DIM * TRACE_MAX_DIM)
+#define TRACE_MAX_OPEN 8     /* pages one instruction may touch */
+#define MAX_GEOMETRIES 16
+#define MAX_SHAPES 64
+#define EFLAGS_TF 0x100      /* x86 trap flag: single-step */
+#define STRIDED_CASES 500    /* random shapes per element width */
+#define STRIDED_MAX_DIM 70   /* past two tiles of every width, with ragged edges */
+#define STRIDED_MAX_PAD 9    /* extra elements per row of a padded view */
+
+typedef struct {
+    int M;
+    int N;
+} matrix_shape;
+
+/* the default shapes: powers of two, primes, skinny, the lab's three */
+static const matrix_shape default_shapes[] = {
+    { 32, 32 }, { 64, 64 }, { 128, 128 }, { 256, 256 },
+    { 61, 67 }, { 67, 61 }, { 31, 37 }, { 127, 131 },
+    { 1, 256 }, { 256, 1 }, { 8, 250 }, { 250, 8 },
+    { 1024, 1024 }, { 2048, 2048 }, { 1000, 1000 }
+};
+#define NUM_DEFAULT_SHAPES ((int) (sizeof(default_shapes) / sizeof(default_shapes[0])))
+
+/* one result row, also what -B reads back */
+typedef struct {
+    char function[128];
+    int M;
+    int N;
+    int s;
+    int E;
+    int b;
+    int correct;
+    long long hits;      /* -1 when the shape wasn't traced */
+    long long misses;
+    long long evictions;
+    double seconds;
+    double gbps;
+} bench_row;
+
+/* the traced region and what the handlers record into it */
+static char *trace_base;
+static size_t trace_len;
+static long page_size;
+static mem_addr_t *trace_addrs;
+static long trace_count;
+static long trace_capacity;
+static int trace_overflow;
+static char *open_pages[TRACE_MAX_OPEN];
+static int num_open;
+
+/*
+ * printUsage - Print usage info
+ */
+static void printUsage(char* argv[])
+{
+    printf("Usage: %s [-hv] [-c <s:E:b> ...] [-n <MxN> ...] [-o <file>] [-B <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v         Print each row to stderr as it is measured.\n");
+    printf("  -c <spec>  Simulate a cache of s:E:b (default 5:1:5, the lab's). May be repeated.\n");
+    printf("  -n <MxN>   Run an M-column, N-row A instead of the default shapes. May be repeated.\n");
+    printf("  -t <secs>  Time each function for at least secs per shape (default 0.02).\n");
+    printf("  -o <file>  Write the rows to file (CSV, or JSON for *.json) instead of stdout.\n");
+    printf("  -B <file>  Compare against an earlier CSV; exit 1 on lost correctness or more misses.\n");
+    printf("\nExamples:\n");
+    printf("  %s -o base.csv\n", argv[0]);
+    printf("  %s -c 5:1:5 -c 8:4:6 -n 64x64 -B base.csv\n", argv[0]);
+    exit(0);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#ifdef BENCH_TRACE
+/* an access to a closed page: record it, open the page for one instruction */
+static void trace_fault(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *) context;
+    char *addr = (char *) info->si_addr;
+    char *page = (char *) ((uintptr_t) addr & ~(uintptr_t) (page_size - 1));
+
+    if (addr < trace_base || addr >= trace_base + trace_len || num_open == TRACE_MAX_OPEN) {
+        /* a real crash: let it happen again without us */
+        signal(SIGSEGV, SIG_DFL);
+        return;
+    }
+    if (trace_count < trace_capacity) {
+        trace_addrs[trace_count++] = (mem_addr_t) (addr - trace_base);
+    } else {
+        trace_overflow = 1;
+    }
+    mprotect(page, page_size, PROT_READ | PROT_WRITE);
+    open_pages[num_open++] = page;
+    uc->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TF;
+}
+
+/* the instruction went through: close its pages and stop stepping */
+static void trace_step(int sig, siginfo_t *info, void *context)
+{
+    ucontext_t *uc = (ucontext_t *) context;
+
+    while (num_open > 0) {
+        mprotect(open_pages[--num_open], page_size, PROT_NONE);
+    }
+    uc->uc_mcontext.gregs[REG_EFL] &= ~(greg_t) EFLAGS_TF;
+}
+
+/* run func on the traced A and B, leaving the addresses in trace_addrs.
+ * returns -1 if the trace didn't fit
+ */
+static int trace_function(const trans_func_t *func, int M, int N)
+{
+    struct sigaction sa;
+    struct sigaction old_segv;
+    struct sigaction old_trap;
+    const char *threads = getenv("TRANS_THREADS");
+    char saved_threads[32];
+
+    /* the trap flag single-steps one thread; traced shapes are under
+     * PARALLEL_MIN_BYTES anyway, this only keeps it that way
+     */
+    if (threads != NULL) {
+        snprintf(saved_threads, sizeof(saved_threads), "%s", threads);
+    }
+    setenv("TRANS_THREADS", "1", 1);
+
+    trace_capacity = 16L * M * N + 1024;
+    trace_addrs = (mem_addr_t *) realloc(trace_addrs, sizeof(mem_addr_t) * trace_capacity);
+    trace_count = 0;
+    trace_overflow = 0;
+    num_open = 0;
+
+    bzero(&sa, sizeof(sa));
+    sa.sa_flags = SA_SIGINFO;
+    sa.sa_sigaction = trace_fault;
+    sigaction(SIGSEGV, &sa, &old_segv);
+    sa.sa_sigaction = trace_step;
+    sigaction(SIGTRAP, &sa, &old_trap);
+
+    mprotect(trace_base, trace_len, PROT_NONE);
+    func->func_ptr(M, N, (int (*)[M]) trace_base, (int (*)[N]) (trace_base + TRACE_MATRIX_BYTES));
+    mprotect(trace_base, trace_len, PROT_READ | PROT_WRITE);
+
+    sigaction(SIGSEGV, &old_segv, NULL);
+    sigaction(SIGTRAP, &old_trap, NULL);
+
+    if (threads != NULL) {
+        setenv("TRANS_THREADS", saved_threads, 1);
+    } else {
+        unsetenv("TRANS_THREADS");
+    }
+    return trace_overflow ? -1 : 0;
+} /* end trace_function */
+#endif
+
+/* replay the recorded addresses into an s:E:b lru cache */
+static void replay_trace(bench_row *row)
+{
+    cache_param_t par;
+    cache this_cache;
+    long k;
+
+    bzero(&par, sizeof(par));
+    par.s = row->s;
+    par.E = row->E;
+    par.b = row->b;
+    this_cache = build_cache(bit_pow(par.s), par.E, bit_pow(par.b), find_policy("lru"));
+    for (k = 0; k < trace_count; k++) {
+        simulate_cache(&this_cache, &par, trace_addrs[k]);
+    }
+    clear_cache(this_cache, bit_pow(par.s), par.E, bit_pow(par.b));
+
+    row->hits = par.hits;
+    row->misses = par.misses;
+    row->evictions = par.evictions;
+}
+
+/* best time of three runs of at least min_seconds each, per call */
+static double time_function(const trans_func_t *func, int M, int N, int *A, int *B, double min_seconds)
+{
+    double best = -1;
+    double start;
+    double elapsed;
+    long calls;
+    int round;
+
+    for (round = 0; round < 3; round++) {
+        calls = 0;
+        start = now();
+        do {
+            func->func_ptr(M, N, (int (*)[M]) A, (int (*)[N]) B);
+            calls++;
+            elapsed = now() - start;
+        } while (elapsed < min_seconds);
+        if (best < 0 || elapsed / calls < best) {
+            best = elapsed / calls;
+        }
+    }
+    return best;
+} /* end time_function */
+
+static void write_row(FILE *out, int json, int first, const bench_row *row)
+{
+    if (json) {
+        fprintf(out, "%s\n  {\"function\": \"%s\", \"M\": %d, \"N\": %d, \"s\": %d, \"E\": %d, \"b\": %d, "
+                "\"correct\": %d, ", first ? "" : ",", row->function, row->M, row->N, row->s, row->E, row->b,
+                row->correct);
+        if (row->misses < 0) {
+            fprintf(out, "\"hits\": null, \"misses\": null, \"evictions\": null, ");
+        } else {
+            fprintf(out, "\"hits\": %lld, \"misses\": %lld, \"evictions\": %lld, ", row->hits, row->misses,
+                    row->evictions);
+        }
+        fprintf(out, "\"seconds\": %.9f, \"gbps\": %.3f}", row->seconds, row->gbps);
+        return;
+    }
+    fprintf(out, "\"%s\",%d,%d,%d,%d,%d,%d,", row->function, row->M, row->N, row->s, row->E, row->b, row->correct);
+    if (row->misses < 0) {
+        fprintf(out, ",,,");
+    } else {
+        fprintf(out, "%lld,%lld,%lld,", row->hits, row->misses, row->evictions);
+    }
+    fprintf(out, "%.9f,%.3f\n", row->seconds, row->gbps);
+} /* end write_row */
+
+/* read an earlier CSV back; returns the number of rows, or -1 if it can't be opened */
+static int read_baseline(const char *path, bench_row **rows)
+{
+    FILE *in = fopen(path, "r");
+    char line[512];
+    int count = 0;
+    int capacity = 0;
+    bench_row row;
+    int used;
+
+    if (in == NULL) {
+        return -1;
+    }
+    *rows = NULL;
+    while (fgets(line, sizeof(line), in) != NULL) {
+        bzero(&row, sizeof(row));
+        used = 0;
+        if (sscanf(line, "\"%127[^\"]\",%d,%d,%d,%d,%d,%d,%n", row.function, &row.M, &row.N,
+                   &row.s, &row.E, &row.b, &row.correct, &used) != 7 || used == 0) {
+            continue; /* the header */
+        }
+        if (sscanf(line + used, "%lld,%lld,%lld", &row.hits, &row.misses, &row.evictions) != 3) {
+            row.misses = -1;
+        }
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            *rows = (bench_row *) realloc(*rows, sizeof(bench_row) * capacity);
+        }
+        (*rows)[count++] = row;
+    }
+    fclose(in);
+    return count;
+} /* end read_baseline */
+
+/* transpose_strided() on random shapes, every element width and padded
+ * leading dimensions, against a byte-wise reference. dst's padding must
+ * come out untouched. returns the number of failed cases, reported on stderr
+ */
+static int check_strided(void)
+{
+    static const int widths[] = { 1, 2, 4, 8 };
+    size_t max_bytes = (size_t) STRIDED_MAX_DIM * (STRIDED_MAX_DIM + STRIDED_MAX_PAD) * 8;
+    unsigned char *src = (unsigned char *) malloc(max_bytes);
+    unsigned char *dst = (unsigned char *) malloc(max_bytes);
+    unsigned int seed = 12345;
+    int failures = 0;
+    int w;
+    int k;
+
+    if (src == NULL || dst == NULL) {
+        printf("bench: Could not allocate the strided check\n");
+        exit(1);
+    }
+
+    for (w = 0; w < 4; w++) {
+        int width = widths[w];
+
+        for (k = 0; k < STRIDED_CASES; k++) {
+            int rows;
+            int cols;
+            long src_ld;
+            long dst_ld;
+            long i;
+            long j;
+            int byte;
+            int bad = 0;
+
+            /* an LCG, so every run checks the same cases */
+            seed = seed * 1103515245 + 12345;
+            rows = 1 + (seed >> 8) % STRIDED_MAX_DIM;
+            seed = seed * 1103515245 + 12345;
+            cols = 1 + (seed >> 8) % STRIDED_MAX_DIM;
+            seed = seed * 1103515245 + 12345;
+            src_ld = cols + (k % 2 ? (seed >> 8) % (STRIDED_MAX_PAD + 1) : 0);
+            dst_ld = rows + (k % 3 ? (seed >> 16) % (STRIDED_MAX_PAD + 1) : 0);
+
+            for (i = 0; i < (long) max_bytes; i++) {
+                src[i] = (unsigned char) (i * 7 + k);
+                dst[i] = 0xa5;
+            }
+            if (transpose_strided(src, src_ld, dst, dst_ld, rows, cols, width) < 0) {
+                bad = 1;
+            }
+            for (i = 0; i < cols && !bad; i++) {
+                for (j = 0; j < dst_ld && !bad; j++) {
+                    for (byte = 0; byte < width; byte++) {
+                        unsigned char want = (j < rows) ? src[(j * src_ld + i) * width + byte] : 0xa5;
+                        if (dst[(i * dst_ld + j) * width + byte] != want) {
+                            bad = 1;
+                        }
+                    }
+                }
+            }
+            if (bad) {
+                fprintf(stderr, "regression: transpose_strided %dx%d of %d-byte elements, ld %ld/%ld, is wrong\n",
+                        rows, cols, width, src_ld, dst_ld);
+                failures++;
+            }
+        }
+    }
+
+    /* what it must refuse */
+    if (transpose_strided(src, 3, dst, 4, 4, 4, 4) != -1 || transpose_strided(src, 4, dst, 3, 4, 4, 4) != -1 ||
+        transpose_strided(src, 4, dst, 4, 4, 4, 3) != -1) {
+        fprintf(stderr, "regression: transpose_strided accepts a short ld or a 3-byte element\n");
+        failures++;
+    }
+
+    free(src);
+    free(dst);
+    return failures;
+} /* end check_strided */
+
+/* 1 if row is worse than its counterpart in the baseline, reported on stderr */
+static int check_regression(const bench_row *row, const bench_row *baseline, int num_baseline)
+{
+    int k;
+
+    for (k = 0; k < num_baseline; k++) {
+        const bench_row *base = &baseline[k];
+        if (strcmp(base->function, row->function) != 0 || base->M != row->M || base->N != row->N ||
+            base->s != row->s || base->E != row->E || base->b != row->b) {
+            continue;
+        }
+        if (base->correct && !row->correct) {
+            fprintf(stderr, "regression: %s %dx%d is no longer a transpose\n", row->function, row->M, row->N);
+            return 1;
+        }
+        if (base->misses >= 0 && row->misses > base->misses) {
+            fprintf(stderr, "regression: %s %dx%d on %d:%d:%d misses %lld, was %lld\n", row->function,
+                    row->M, row->N, row->s, row->E, row->b, row->misses, base->misses);
+            return 1;
+        }
+        return 0;
+    }
+    return 0;
+} /* end check_regression */
+
+int main(int argc, char **argv)
+{
+    int geometries[MAX_GEOMETRIES][3];
+    int num_geometries = 0;
+    matrix_shape shapes[MAX_SHAPES];
+    int num_shapes = 0;
+    double min_seconds = 0.02;
+    char *out_file = NULL;
+    FILE *out = stdout;
+    int json = 0;
+    char *baseline_file = NULL;
+    bench_row *baseline = NULL;
+    int num_baseline = 0;
+    int regressions = 0;
+    int first = 1;
+    int *A;
+    int *B;
+    int f;
+    int k;
+    int g;
+
+    char c;
+    while ((c = getopt(argc, argv, "c:n:t:o:B:vh")) != -1) {
+        switch (c) {
+        case 'c':
+            if (num_geometries == MAX_GEOMETRIES ||
+                sscanf(optarg, "%d:%d:%d", &geometries[num_geometries][0], &geometries[num_geometries][1],
+                       &geometries[num_geometries][2]) != 3 ||
+                geometries[num_geometries][0] < 0 || geometries[num_geometries][1] < 1 ||
+                geometries[num_geometries][2] < 0) {
+                printf("%s: Invalid cache geometry %s\n", argv[0], optarg);
+                exit(1);
+            }
+            num_geometries++;
+            break;
+        case 'n':
+            if (num_shapes == MAX_SHAPES ||
+                sscanf(optarg, "%dx%d", &shapes[num_shapes].M, &shapes[num_shapes].N) != 2 ||
+                shapes[num_shapes].M < 1 || shapes[num_shapes].N < 1) {
+                printf("%s: Invalid matrix shape %s\n", argv[0], optarg);
+                exit(1);
+            }
+            num_shapes++;
+            break;
+        case 't':
+            min_seconds = atof(optarg);
+            break;
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'B':
+            baseline_file = optarg;
+            break;
+        case 'v':
+            verbosity = 1;
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+
+    if (num_geometries == 0) {
+        geometries[0][0] = 5;
+        geometries[0][1] = 1;
+        geometries[0][2] = 5;
+        num_geometries = 1;
+    }
+    if (num_shapes == 0) {
+        memcpy(shapes, default_shapes, sizeof(default_shapes));
+        num_shapes = NUM_DEFAULT_SHAPES;
+    }
+    if (baseline_file != NULL && (num_baseline = read_baseline(baseline_file, &baseline)) < 0) {
+        printf("%s: Could not read %s\n", argv[0], baseline_file);
+        exit(1);
+    }
+    if (out_file != NULL) {
+        if ((out = fopen(out_file, "w")) == NULL) {
+            printf("%s: Could not write %s\n", argv[0], out_file);
+            exit(1);
+        }
+        json = strlen(out_file) > 5 && strcmp(out_file + strlen(out_file) - 5, ".json") == 0;
+    }
+
+    /* tracegen's layout: B right after the whole of A */
+    page_size = sysconf(_SC_PAGESIZE);
+    trace_len = 2 * TRACE_MATRIX_BYTES;
+    trace_base = (char *) mmap(NULL, trace_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (trace_base == MAP_FAILED) {
+        printf("%s: Could not map the traced matrices\n", argv[0]);
+        exit(1);
+    }
+
+    registerFunctions();
+    regressions += check_strided();
+    fprintf(out, json ? "[" : "function,M,N,s,E,b,correct,hits,misses,evictions,seconds,gbps\n");
+
+    for (k = 0; k < num_shapes; k++) {
+        int M = shapes[k].M;
+        int N = shapes[k].N;
+        long elements = (long) M * N;
+        int traced = 0;
+
+        /* timing and the correctness check get their own buffers */
+        A = (int *) malloc(sizeof(int) * elements);
+        B = (int *) malloc(sizeof(int) * elements);
+        if (A == NULL || B == NULL) {
+            printf("%s: Could not allocate %dx%d\n", argv[0], M, N);
+            exit(1);
+        }
+        initMatrix(M, N, (int (*)[M]) A, (int (*)[N]) B);
+
+        /* the in-place kernel itself, on a copy of A, checked against A */
+        if (M == N) {
+            memcpy(B, A, sizeof(int) * elements);
+            transpose_square_in_place(N, (int (*)[N]) B);
+            if (!is_transpose_in_place(N, (int (*)[N]) B, (int (*)[N]) A)) {
+                fprintf(stderr, "regression: transpose_square_in_place %dx%d is not a transpose\n", M, N);
+                regressions++;
+            }
+        }
+
+        for (f = 0; f < func_counter; f++) {
+            bench_row row;
+
+            bzero(&row, sizeof(row));
+            strncpy(row.function, func_list[f].description, sizeof(row.function) - 1);
+            row.M = M;
+            row.N = N;
+
+            memset(B, 0, sizeof(int) * elements);
+            func_list[f].func_ptr(M, N, (int (*)[M]) A, (int (*)[N]) B);
+            row.correct = is_transpose(M, N, (int (*)[M]) A, (int (*)[N]) B);
+            row.seconds = time_function(&func_list[f], M, N, A, B, min_seconds);
+            row.gbps = 2.0 * sizeof(int) * elements / row.seconds / 1e9;
+
+#ifdef BENCH_TRACE
+            traced = M <= TRACE_MAX_DIM && N <= TRACE_MAX_DIM && trace_function(&func_list[f], M, N) == 0;
+#endif
+            for (g = 0; g < num_geometries; g++) {
+                row.s = geometries[g][0];
+                row.E = geometries[g][1];
+                row.b = geometries[g][2];
+                row.hits = row.misses = row.evictions = -1;
+                if (traced) {
+                    replay_trace(&row);
+                }
+                write_row(out, json, first, &row);
+                first = 0;
+                if (verbosity) {
+                    write_row(stderr, 0, 0, &row);
+                }
+                regressions += check_regression(&row, baseline, num_baseline);
+            }
+        }
+        free(A);
+        free(B);
+    }
+
+    if (json) {
+        fprintf(out, "\n]\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(baseline);
+    free(trace_addrs);
+    munmap(trace_base, trace_len);
+    return regressions > 0;
+}
@@ -5,12 +5,98 @@
  *
  * Implementation and assumptions:
  *  1. Each load/store can cause at most one cache miss. (I examined the trace,
- *  the largest request I saw was for 8 bytes).
+ *  the largest request I saw was for 8 bytes). -z honors the access size
+ *  instead: an access that straddles a block boundary looks up every block
+ *  it touches, and the lookups past the first are reported as extra_lookups.
  *  2. Instruction loads (I) are ignored, since we are interested in evaluating
  *  trans.c in terms of its data cache performance.
  *  3. data modify (M) is treated as a load followed by a store to the same
  *  address. Hence, an M operation can result in two cache hits, or a miss and a
  *  hit plus an possible eviction.
+ *  4. traces are read through a hand-rolled scanner instead of fscanf. regular
+ *  files are mmap'd whole; pipes and stdin (-t -) fall back to reading the
+ *  trace in fixed size chunks. the scanner accepts the same records as
+ *  fscanf(" %c %llx,%d") and stops at the first record it cannot decode.
+ *  streamed input (stdin, pipes, fifos) is decoded on a reader thread into a
+ *  ring of record batches, so valgrind, the parser and the simulation all
+ *  run at once and lackey's output never has to touch the disk.
+ *  gzip and zstd traces (either format inside) are decompressed on the fly
+ *  when csim is built with CSIM_ZLIB / CSIM_ZSTD. a mapped file made of
+ *  independent frames (several zstd frames, or bgzip blocks) has its frames
+ *  decompressed in parallel on worker threads and handed to the scanner in
+ *  order; anything else is decompressed as one stream.
+ *  5. -T converts a trace into the binary format described below, and -t
+ *  accepts either format, telling them apart by the magic header.
+ *  6. -S sweeps several cache configurations in one pass: every decoded
+ *  record is fed to one cache per (s, E, b) tuple and each prints its own
+ *  summary line.
+ *  7. -A runs a stack-distance (Mattson) analysis instead: one replay at a
+ *  fixed s and b yields the LRU hits/misses/evictions of every E = 1..N.
+ *  8. for E >= 8 the tag lookup compares 8 ways at a time with packed 64-bit
+ *  compares (AVX2, SSE4.2 or NEON, picked at runtime). -l forces one of them,
+ *  or the scalar reference, for checking.
+ *  9. sets never interact, so -j splits the sets into contiguous shards and
+ *  simulates each shard on its own thread. the main thread decodes the trace
+ *  once and routes every access through a single-producer single-consumer
+ *  queue to the shard owning its set; counters are summed at the end, so the
+ *  output is identical to a single-threaded run.
+ *  10. the replacement policy is pluggable (-p): lru (the default), fifo,
+ *  random, plru (tree pseudo-LRU), srrip (2-bit RRIP) or lfu. each policy
+ *  keeps only the per-set metadata it needs next to the tags.
+ *  11. -L chains further cache levels below the -s/-E/-b one. a miss in one
+ *  level is looked up in the next, and each level has its own geometry,
+ *  policy and inclusion mode: nine (the default) fills every level it
+ *  missed in, inclusive also back-invalidates the levels above when it
+ *  evicts, and exclusive only receives the victims of the level above and
+ *  hands its hits up to it. both move whole blocks between levels, so an
+ *  inclusive or exclusive level must have the same b as every level above
+ *  it; -L rejects one that doesn't. nine levels may use any block size.
+ *  12. stores follow the write policy chosen with -W: write-back or
+ *  write-through, with or without write-allocate. lines carry a dirty bit,
+ *  and -W adds a second summary line with dirty evictions and the bytes
+ *  written to memory. the default (write-back, write-allocate) counts hits,
+ *  misses and evictions exactly as before. -L levels treat stores as loads.
+ *  13. -H writes hits, misses and evictions per set, and -P per instruction
+ *  (a data access belongs to the I record before it), as CSV or, for a file
+ *  name ending in .json, as JSON. they replay through a separate loop, so a
+ *  run without them pays nothing for the counters.
+ *  14. -C labels every miss compulsory, capacity or conflict (the 3C model)
+ *  by replaying a fully associative LRU cache of the same number of lines
+ *  next to the real one; a block never seen before is a compulsory miss, a
+ *  miss the shadow also takes is a capacity miss and the rest are conflict
+ *  misses. it uses the instrumented loop, and -H/-P get the classes too.
+ *  15. -F adds a hardware prefetcher fed by the demand accesses: next-N-line,
+ *  a per-PC stride table or stream detectors. prefetched blocks arrive a
+ *  fixed number of demand accesses after they were issued and are filled
+ *  into the cache without counting as hits or misses; evictions they cause
+ *  are counted. a summary line reports how many prefetches were issued,
+ *  useful (hit before eviction), late (the demand miss came first) and
+ *  polluting (evicted unused).
+ *  16. for very long traces -k fast-forwards over the first N records
+ *  without simulating them, and -w replays the next M to warm the cache
+ *  without counting them. -m unit:period[:warm] then samples: out of every
+ *  period records it skips ahead, warms the cache on warm records and
+ *  counts the next unit. the summary counts only the sampled records; an
+ *  estimated_* line scales them up to every record after the -k ones, and
+ *  a last line gives 95% confidence intervals taken from the spread
+ *  between samples.
+ *  17. -i K writes a CSV row with the interval's hits, misses and evictions
+ *  every K accesses (an M is two), and also at every marker record: op X,
+ *  whose address is written as the marker's id. -i 0 only splits at
+ *  markers. rows go to stdout or to the -I file.
+ *  18. -o file:N saves the whole cache (tags, valid and dirty bits, the
+ *  policy's metadata and clock, plus the counters so far) after N counted
+ *  records and stops; without :N it saves at the end of the trace. -r file
+ *  starts a later run, on any trace, from that state instead of a cold
+ *  cache. the arena is stored as-is behind a page of header and mapped
+ *  back copy-on-write, so restoring costs nothing for the sets the new
+ *  trace never touches. the summary counts only the new run.
+ *  19. the engine itself (build_cache, simulate_cache, the policies) is
+ *  declared in csim.h. built with -DCSIM_NO_MAIN, csim.c leaves out main so
+ *  other programs, like the transpose tuner in tune.c, can link it and
+ *  feed it addresses directly. code written against csim_trace.h's
+ *  TRACE_LOAD/TRACE_STORE accessors and built with -DCSIM_TRACE sends its
+ *  own loads and stores here as it runs.
  *
  * The function printSummary() is given to print output.
  * Please use this function to print the number of hits, misses and evictions.
@@ -19,51 +105,379 @@
  * Author: Iris Yuan
  */
 
+#define _GNU_SOURCE /* for madvise under -std=c99 */
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <getopt.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
 #include <strings.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sched.h>
+#include <pthread.h>
 #include "cachelab.h"
+#include "csim.h"
+#include "csim_trace.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CSIM_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define CSIM_NEON 1
+#endif
+
+/* compressed traces need the libraries at build time:
+ * -DCSIM_ZLIB ... -lz for gzip, -DCSIM_ZSTD ... -lzstd for zstd
+ */
+#ifdef CSIM_ZLIB
+#include <zlib.h>
+#endif
+#ifdef CSIM_ZSTD
+#include <zstd.h>
+#endif
 
 #include <math.h> /* for exponentiation to compute S and B */
 
-/* always use a 64-bit variable to hold memory addresses*/
-typedef unsigned long long int mem_addr_t;
+/* how a level of a hierarchy relates to the levels above it */
+#define INCLUSION_NINE 0      /* non-inclusive non-exclusive */
+#define INCLUSION_INCLUSIVE 1 /* holds every block of the levels above */
+#define INCLUSION_EXCLUSIVE 2 /* holds no block of the level above */
+
+/* most levels -L can chain */
+#define MAX_LEVELS 8
+
+/* binary trace format (written by -T), all fields little-endian:
+ *  header:  8 byte magic, 32-bit version, 32-bit flags
+ *  records: op byte, size byte, 64-bit address
+ * with TRACE_FLAG_DELTA the address is instead stored as the zigzag varint
+ * of its difference from the previous record's address (usually 1-3 bytes)
+ */
+#define TRACE_MAGIC "\223CSIMTRC"
+#define TRACE_MAGIC_LEN 8
+#define TRACE_HEADER_SIZE 16
+#define TRACE_VERSION 1
+#define TRACE_RECORD_SIZE 10 /* op + size + address, without delta encoding */
+
+/* size of each read() when the trace can't be mmap'd (pipes, stdin) */
+#define TRACE_CHUNK_SIZE (1 << 20)
 
-/* a struct for each set line (memory addresses)
- * composed of valid bit, tag bit, and block offset data bytes
+/* record batches a streamed trace's reader thread decodes ahead */
+#define TRACE_RING_BATCHES 4
+#define TRACE_RING_BATCH 4096
+
+/* batches handed from the reader thread to the simulation. batches
+ * [head, tail) are decoded and the consumer owns batch head while it
+ * drains it; handoffs are once per batch, so a lock and condition
+ * variable are cheap and let either side sleep while valgrind is slow
  */
 typedef struct {
-    int valid; 
-    int access_count; /* counts last used lines in a set */
-    mem_addr_t tag;
-    char *block;
-} set_line;
+    trace_record *records;          /* TRACE_RING_BATCHES * TRACE_RING_BATCH */
+    int counts[TRACE_RING_BATCHES]; /* records in each decoded batch */
+    unsigned long long head;        /* batches released by the consumer */
+    unsigned long long tail;        /* batches published by the reader thread */
+    int done;                       /* the thread hit the end of the trace */
+    int stop;                       /* the consumer is closing the trace */
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t thread;
+
+    const trace_record *current;    /* consumer: batch being drained */
+    int current_count;
+    int current_pos;
+} trace_ring;
+
+/* compressed trace formats, told apart by their magic bytes */
+#define TRACE_GZIP 1
+#define TRACE_ZSTD 2
+
+#define INFLATE_JOB_BYTES (1 << 20) /* compressed bytes a parallel job gathers at least */
+#define INFLATE_MAX_THREADS 16
+
+/* decompression state for one stream of gzip members or zstd frames */
+typedef struct {
+    int format;
+    int failed;    /* hit corrupt input; what came before it is still delivered */
+#ifdef CSIM_ZLIB
+    z_stream zs;
+#endif
+#ifdef CSIM_ZSTD
+    ZSTD_DStream *zds;
+#endif
+} inflate_stream;
+
+/* a run of whole frames that one worker decompresses */
+typedef struct {
+    size_t start;  /* compressed bytes [start, end) of the mapping */
+    size_t end;
+    char *data;    /* decompressed bytes */
+    size_t len;
+    int state;     /* 0 queued or running, 1 done, -1 corrupt */
+} inflate_job;
+
+/* the source of a compressed trace's bytes. a whole mapped file that
+ * splits into several jobs is decompressed in parallel, keeping at most
+ * window jobs beyond the one being scanned; otherwise one stream inflates
+ * the mapping or what read() delivers into the reader's chunk buffer
+ */
+typedef struct {
+    inflate_stream stream;
+    const unsigned char *input; /* compressed bytes: the mapping, or in_buf */
+    size_t input_len;
+    size_t input_pos;
+    int input_eof;              /* no more compressed bytes will arrive */
+    unsigned char *in_buf;      /* read() buffer for streamed input */
+    void *map;                  /* mapping to release, NULL for streamed input */
+    size_t map_len;
+
+    inflate_job *jobs;          /* NULL unless decompressing in parallel */
+    int num_jobs;
+    int next_job;               /* next job a worker picks up */
+    int reading;                /* job the scanner is on, -1 before the first */
+    int window;
+    int stop;
+    int num_threads;
+    pthread_t threads[INFLATE_MAX_THREADS];
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} trace_inflater;
+
+/* reads trace bytes either from a mapping of the whole file or
+ * from a buffer that is refilled chunk by chunk
+ */
+typedef struct {
+    int fd;
+    const char *data; /* bytes currently available to the scanner */
+    size_t len;       /* number of valid bytes in data */
+    size_t pos;       /* scanner position within data */
+    char *buf;        /* chunk buffer, NULL when the file is mapped */
+    int mapped;
+    int eof;
+
+    int binary;              /* 1 if the trace starts with TRACE_MAGIC */
+    int delta;               /* binary trace uses TRACE_FLAG_DELTA */
+    mem_addr_t prev_address; /* base for the next delta-encoded address */
+
+    trace_ring *ring;        /* reader thread of a streamed trace, or NULL */
+    trace_inflater *inflater; /* decompresses a gzip or zstd trace, or NULL */
+} trace_reader;
+
+/* most configurations a single -S sweep will simulate */
+#define MAX_SWEEP_CONFIGS 4096
+
+/* records decoded at a time in a sweep before being replayed into each cache */
+#define SWEEP_BATCH 4096
+
+/* per-set state of the stack-distance analysis.
+ * every access gets a local timestamp; a Fenwick tree over timestamps marks
+ * the most recent access of each block, so the number of distinct blocks used
+ * since a block's last access is a prefix-sum difference. the timeline is
+ * compacted down to the live marks whenever it fills up
+ */
+typedef struct {
+    int *tree;            /* Fenwick tree over timestamps 1..capacity */
+    mem_addr_t *block_at; /* block accessed at each timestamp */
+    char *live;           /* 1 if that timestamp is its block's most recent access */
+    long long now;        /* last timestamp handed out */
+    long long capacity;
+    long long distinct;   /* blocks seen in this set so far */
+} sd_set;
+
+/* open addressing map from block number to its set-local last access time */
+typedef struct {
+    mem_addr_t *keys; /* block number + 1, 0 marks an empty slot */
+    long long *times;
+    long long capacity; /* power of two */
+    long long count;
+} sd_map;
+
+/* first timeline size of a set, doubled as needed */
+#define SD_INITIAL_CAPACITY 64
+
+/* most worker threads -j will start */
+#define MAX_SHARDS 64
+
+/* accesses each shard queue can hold (power of two) */
+#define SHARD_QUEUE_SIZE (1 << 16)
+
+/* accesses the decoder buffers before publishing them to a shard */
+#define SHARD_PUBLISH_BATCH 256
+
+/* the host's cache line: the decoder's and a shard's fields of a queue, and
+ * each shard's counters, get lines of their own so neither side's stores
+ * invalidate the other's
+ */
+#define HOST_LINE_BYTES 64
+#define HOST_LINE_ALIGNED __attribute__((aligned(HOST_LINE_BYTES)))
+
+/* lock-free ring of accesses from the decoder to one shard. head is only
+ * written by the shard's thread and tail only by the decoder; each side
+ * keeps a cached copy of the other's index and a private cursor on its
+ * own cache line. the alignment also rounds sizeof up to whole lines
+ */
+typedef struct {
+    trace_record *items; /* single accesses: op is L or S */
+
+    unsigned long long tail HOST_LINE_ALIGNED; /* accesses published by the decoder */
+    unsigned long long write_pos;   /* decoder: next slot to fill */
+    unsigned long long cached_head; /* decoder: last head it loaded */
+    int done;                       /* decoder has published everything */
+
+    unsigned long long head HOST_LINE_ALIGNED; /* accesses consumed by the shard */
+    unsigned long long cached_tail; /* shard: last tail it loaded */
+} shard_queue;
 
-/* similar to struct cache below, each cache_set will hold E number of lines */
+/* one worker thread and the sets it owns. workers sit in an array
+ * allocated on a line boundary, and every line of one is written by a
+ * single thread, the decoder or this shard
+ */
 typedef struct {
-    set_line *lines;
-} cache_set;
+    pthread_t thread;
+    shard_queue queue;
+    cache shard_cache HOST_LINE_ALIGNED; /* shares the arena, but has its own LRU clock */
+    cache_param_t par;   /* this shard's hits, misses and evictions */
+} shard_worker;
 
-/* a cache can be thought of as an array of sets */
+/* one level of a -L hierarchy, L1 first */
 typedef struct {
-    cache_set *sets;
-} cache;
+    cache level_cache;
+    cache_param_t par;
+    int inclusion; /* INCLUSION_* towards the levels above */
+} cache_level;
 
-/* a struct that groups cache parameters together 
- * (given from lab - added parameters to count hits, misses, evictions) 
+/* what -H keeps per set and -P per instruction. the three miss classes
+ * are only filled in under -C
  */
 typedef struct {
-    int s; /* 2**s cache sets */
-    int b; /* cacheline block size 2**b bytes */
-    int E; /* number of cachelines per set */
-    int S; /* number of sets, derived from S = 2**s */
-    int B; /* cacheline block size (bytes), derived from B = 2**b */
-    
     int hits;
     int misses;
     int evictions;
-} cache_param_t;
+    int dirty_evictions;
+
+    int compulsory; /* first access to the block */
+    int capacity;   /* a fully associative cache of the same size misses too */
+    int conflict;   /* the fully associative cache would have hit */
+} access_stats;
+
+/* -C: a fully associative LRU cache with as many lines as the real one.
+ * every block ever accessed stays in the map, so it doubles as the set of
+ * blocks seen so far; a block that was evicted from the shadow keeps its
+ * key with line -1
+ */
+typedef struct {
+    mem_addr_t *keys;       /* block + 1, 0 for an empty slot */
+    int *lines;             /* shadow line holding the block, or -1 */
+    long long capacity;     /* power of two */
+    long long count;
+
+    mem_addr_t *line_block; /* block in each line */
+    int *prev;              /* LRU list through the lines, head is MRU */
+    int *next;
+    int num_lines;
+    int used;               /* lines filled so far */
+    int head;
+    int tail;
+} shadow_cache;
+
+#define SHADOW_HIT 0
+#define SHADOW_COMPULSORY 1
+#define SHADOW_CAPACITY 2
+
+/* -F prefetchers */
+#define PREFETCH_NEXT 0   /* next-N-line, tagged: triggered by misses and first uses */
+#define PREFETCH_STRIDE 1 /* per-PC stride table */
+#define PREFETCH_STREAM 2 /* stream detectors walking ahead of sequential misses */
+#define PREFETCH_QUEUE 64   /* prefetches in flight at most */
+#define PREFETCH_MAX_DEGREE 16
+#define STRIDE_TABLE 256    /* direct mapped by PC */
+#define STREAM_COUNT 8
+
+typedef struct {
+    mem_addr_t pc;
+    mem_addr_t last;    /* last address the instruction accessed */
+    long long stride;
+    int confidence;     /* 0..3, prefetches from 2 on */
+} stride_entry;
+
+typedef struct {
+    mem_addr_t last;    /* last block that advanced the stream */
+    int direction;      /* 1 ascending, -1 descending, 0 not known yet */
+    unsigned long long stamp; /* last use, 0 for a free detector */
+} stream_entry;
+
+typedef struct {
+    int kind;           /* PREFETCH_* */
+    int degree;         /* blocks fetched ahead per trigger */
+    int latency;        /* demand accesses before a prefetch arrives */
+    long long now;      /* demand accesses so far */
+
+    /* ring of prefetches in flight, in the order they arrive */
+    mem_addr_t queue_block[PREFETCH_QUEUE];
+    long long queue_due[PREFETCH_QUEUE];
+    char queue_live[PREFETCH_QUEUE]; /* 0 once a demand miss took the block */
+    int queue_head;
+    int queue_count;
+
+    stride_entry strides[STRIDE_TABLE];
+    stream_entry streams[STREAM_COUNT];
+
+    int issued;         /* prefetches sent for blocks not cached or in flight */
+    int useful;         /* prefetched lines a demand access used */
+    int late;           /* demand misses on a block still in flight */
+    int polluting;      /* prefetched lines evicted before any use */
+} prefetcher;
+
+/* -m: count unit records out of every period, after warming the cache on
+ * the warm records just before them
+ */
+typedef struct {
+    long long unit;
+    long long period;
+    long long warm;
+} sample_spec;
+
+/* -m's counters, summed over samples or scaled up to the whole trace.
+ * long long, since sampled traces run to billions of accesses
+ */
+typedef struct {
+    long long hits;
+    long long misses;
+    long long evictions;
+    long long dirty_evictions;
+    long long bytes_written;
+    long long extra_lookups;
+} sample_totals;
+
+/* what -m measured and the totals it estimates from that */
+typedef struct {
+    int samples;
+    long long records;  /* records after -k, skipped or not */
+    long long measured; /* records counted in samples */
+    long long hits_ci;  /* 95% confidence half-widths, -1 with fewer than 2 samples */
+    long long misses_ci;
+    long long evictions_ci;
+    sample_totals counted;  /* exact sums over the counted records */
+    sample_totals estimate; /* counted scaled to every record after -k */
+} sample_result;
+
+/* open addressing from a PC to its access_stats */
+typedef struct {
+    mem_addr_t *keys;     /* pc + 1, 0 for an empty slot */
+    access_stats *stats;
+    long long capacity;   /* always a power of two */
+    long long count;
+} pc_map;
+
+/* a pc_map entry, for sorting the -P output */
+typedef struct {
+    mem_addr_t pc;
+    access_stats stats;
+} pc_entry;
 
 int verbosity; /* to use with -v */
 
@@ -73,221 +487,3437 @@ int verbosity; /* to use with -v */
 void printUsage(char* argv[])
 {
     printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -t <file>\n", argv[0]);
+    printf("       %s [-hv] -S <s:E:b> [-S <s:E:b> ...] -t <file>\n", argv[0]);
+    printf("       %s [-hv] -s <num> -b <num> -A <num> -t <file>\n", argv[0]);
+    printf("       %s [-D] -T <out> -t <file>\n", argv[0]);
     printf("Options:\n");
     printf("  -h         Print this help message.\n");
     printf("  -v         Optional verbose flag.\n");
     printf("  -s <num>   Number of set index bits.\n");
     printf("  -E <num>   Number of lines per set.\n");
     printf("  -b <num>   Number of block offset bits.\n");
-    printf("  -t <file>  Trace file.\n");
+    printf("  -t <file>  Trace file, text or binary (- reads from stdin).\n");
+    printf("  -T <out>   Convert the trace to binary format instead of simulating.\n");
+    printf("  -D         Delta-encode addresses when converting with -T.\n");
+    printf("  -S <spec>  Sweep configurations in one pass; each of s, E, b is a number,\n");
+    printf("             a range lo-hi or a list a,b,c. May be repeated.\n");
+    printf("  -A <num>   LRU stack-distance analysis for every E from 1 to num.\n");
+    printf("  -l <impl>  Tag lookup for E >= %d: auto, avx2, sse4, neon or scalar.\n", SIMD_MIN_WAYS);
+    printf("  -j <num>   Simulate with the sets split across num threads.\n");
+    printf("  -p <name>  Replacement policy: lru (default), fifo, random, plru, srrip or lfu.\n");
+    printf("  -W <mode>  Write policy wb-wa (default), wb-nwa, wt-wa or wt-nwa, and\n");
+    printf("             report dirty evictions and bytes written to memory.\n");
+    printf("  -L <spec>  Add a cache level below the previous one, as s:E:b[:policy[:mode]]\n");
+    printf("             with mode nine (default), inclusive or exclusive. May be repeated.\n");
+    printf("  -z         Split accesses that cross a block boundary into one lookup per block.\n");
+    printf("  -H <file>  Write per-set hits, misses and evictions (CSV, or JSON for *.json).\n");
+    printf("  -P <file>  Write the same counters per instruction address, most misses first.\n");
+    printf("  -C         Classify misses as compulsory, capacity or conflict.\n");
+    printf("  -F <spec>  Prefetch as kind[:degree[:latency]], kind next, stride or stream;\n");
+    printf("             latency is in demand accesses (default 1:0).\n");
+    printf("  -i <num>   Write interval hits, misses and evictions as CSV every num accesses\n");
+    printf("             and at X marker records (0: only at markers).\n");
+    printf("  -I <file>  Write the -i rows to file instead of stdout.\n");
+    printf("  -k <num>   Skip the first num records without simulating them.\n");
+    printf("  -w <num>   Warm the cache on the next num records without counting them.\n");
+    printf("  -m <spec>  Sample unit:period[:warm] records and estimate the totals with\n");
+    printf("             95%% confidence intervals; warm defaults to unit.\n");
+    printf("  -o <spec>  Save the cache state to file[:num], after num counted records\n");
+    printf("             (stopping there) or at the end of the trace.\n");
+    printf("  -r <file>  Start from a saved cache state; it sets s, E, b and the policy.\n");
     printf("\nExamples:\n");
     printf("  %s -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
     printf("  %s -v -s 8 -E 2 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -S 1-8:1,2,4:4 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -j 4 -s 12 -E 16 -b 6 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -p plru -s 4 -E 8 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -s 6 -E 8 -b 6 -L 9:8:6 -L 12:16:6:srrip:inclusive -t traces/yi.trace\n", argv[0]);
+    printf("  %s -W wt-nwa -s 4 -E 1 -b 4 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -z -s 4 -E 1 -b 2 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -s 5 -E 1 -b 5 -H sets.csv -P pcs.json -t traces/yi.trace\n", argv[0]);
+    printf("  %s -C -s 5 -E 1 -b 5 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -F stream:4:8 -s 5 -E 1 -b 5 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -i 100000 -I phases.csv -s 10 -E 8 -b 6 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -k 1000000 -w 100000 -m 10000:1000000 -s 10 -E 8 -b 6 -t big.trace\n", argv[0]);
+    printf("  %s -s 10 -E 8 -b 6 -o warm.ckpt:1000000 -t big.trace\n", argv[0]);
+    printf("  %s -r warm.ckpt -t other.trace\n", argv[0]);
+    printf("  %s -s 4 -b 4 -A 16 -t traces/yi.trace\n", argv[0]);
+    printf("  %s -D -T traces/yi.bin -t traces/yi.trace\n", argv[0]);
     exit(0);
 }
 
-/* cache = sets * lines * blocks */
-/* build a cache given arbitrary s (num_sets), E (num_lines), and b (block_size) values */
-cache build_cache (long long num_sets, int num_lines, long long block_size) {
+/* lay a cache out over an arena sized for num_sets sets of num_lines lines:
+ * tags, then the per-set metadata, then the valid bytes
+ */
+cache build_cache_view(char *arena, long long num_sets, int num_lines, const replacement_policy *policy)
+{
+    cache newCache;
+    long long total_lines = num_sets * num_lines;
+    int meta_bytes = policy->meta_bytes(num_lines);
+
+    newCache.tags = (mem_addr_t *) arena;
+    newCache.meta = (unsigned char *) (arena + total_lines * sizeof(mem_addr_t));
+    newCache.valid = newCache.meta + num_sets * meta_bytes;
+    newCache.meta_bytes = meta_bytes;
+    newCache.policy = policy;
+    newCache.clock = 0;
+    newCache.evicted = 0;
+    newCache.evicted_flags = 0;
+    newCache.write_through = 0;
+    newCache.write_allocate = 1;
+    newCache.mapping = NULL;
+    newCache.mapping_len = 0;
+
+    return newCache;
+} /* end build_cache_view */
+
+/* cache = sets * lines * blocks */
+/* build a cache given arbitrary s (num_sets), E (num_lines), and b (block_size) values,
+ * replacing lines with the given policy.
+ * block data is never simulated, so block_size doesn't change the layout
+ */
+cache build_cache (long long num_sets, int num_lines, long long block_size, const replacement_policy *policy) {
+
+    long long total_lines = num_sets * num_lines;
+    int meta_bytes = policy->meta_bytes(num_lines);
+    char *arena;
+
+    /* from lab instructions, use malloc function to allocate storage.
+     * one zeroed allocation holds every array: all lines start invalid
+     */
+    arena = (char *) calloc(total_lines * (sizeof(mem_addr_t) + 1) + num_sets * meta_bytes, 1);
+
+    return build_cache_view(arena, num_sets, num_lines, policy);
+} /* end build_cache */
+
+/* call free function to clean up cache after main simulation is run */
+void clear_cache(cache this_cache, long long num_sets, int num_lines, long long block_size) 
+{
+    /* tags is the start of the arena, unless it was mapped from a checkpoint */
+    if (this_cache.mapping != NULL) {
+        munmap(this_cache.mapping, this_cache.mapping_len);
+    } else if (this_cache.tags != NULL) {
+        free(this_cache.tags);
+    }
+} /* end clear_cache */
+
+/* metadata sizes: a 64-bit word per way, a byte per way, or one word per set */
+int meta_word_per_way(int num_lines) { return sizeof(unsigned long long) * num_lines; }
+int meta_byte_per_way(int num_lines) { return num_lines; }
+int meta_word_per_set(int num_lines) { return sizeof(unsigned long long); }
+
+/* way holding the smallest 64-bit value, the first one on ties */
+static inline int min_word_way(const unsigned char *meta, int num_lines)
+{
+    const unsigned long long *words = (const unsigned long long *) meta;
+    int victim = 0;
+    int way;
+
+    for (way = 1; way < num_lines; way++) {
+        if (words[way] < words[victim]) {
+            victim = way;
+        }
+    }
+    return victim;
+}
+
+/* lru and fifo: each way's word is the clock when it was last used / filled */
+void stamp_way(cache *this_cache, unsigned char *meta, int way, int num_lines)
+{
+    ((unsigned long long *) meta)[way] = ++this_cache->clock;
+}
+
+void ignore_way(cache *this_cache, unsigned char *meta, int way, int num_lines) {}
+
+int oldest_way(cache *this_cache, unsigned char *meta, int num_lines)
+{
+    return min_word_way(meta, num_lines);
+}
+
+/* random: the set's word is its own xorshift state, so sharded runs
+ * draw the same victims as single-threaded ones
+ */
+int random_way(cache *this_cache, unsigned char *meta, int num_lines)
+{
+    unsigned long long *state = (unsigned long long *) meta;
+    unsigned long long x = *state ? *state : 0x9e3779b97f4a7c15ULL;
+
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return (int) (x % num_lines);
+}
+
+/* plru: the set's word holds the E-1 nodes of a binary tree, node i with
+ * children 2i+1 and 2i+2. a node's bit says which half holds the victim
+ */
+void plru_touch(cache *this_cache, unsigned char *meta, int way, int num_lines)
+{
+    unsigned long long *tree = (unsigned long long *) meta;
+    int node = 0;
+    int level;
+
+    /* walk from the root towards way, pointing every node at the other half */
+    for (level = __builtin_ctz(num_lines) - 1; level >= 0; level--) {
+        int right = (way >> level) & 1;
+        if (right) {
+            *tree &= ~(1ULL << node);
+        } else {
+            *tree |= 1ULL << node;
+        }
+        node = 2 * node + 1 + right;
+    }
+}
+
+int plru_victim(cache *this_cache, unsigned char *meta, int num_lines)
+{
+    unsigned long long tree = *(unsigned long long *) meta;
+    int node = 0;
+    int way = 0;
+
+    while (node < num_lines - 1) {
+        int right = (tree >> node) & 1;
+        way = 2 * way + right;
+        node = 2 * node + 1 + right;
+    }
+    return way;
+}
+
+/* srrip: a 2-bit re-reference prediction per way. new lines are predicted
+ * to be reused late (2), hits predict near reuse (0), and the victim is a
+ * way predicted distant (3), aging the whole set until one is
+ */
+#define RRPV_MAX 3
+
+void srrip_touch(cache *this_cache, unsigned char *meta, int way, int num_lines)
+{
+    meta[way] = 0;
+}
+
+void srrip_fill(cache *this_cache, unsigned char *meta, int way, int num_lines)
+{
+    meta[way] = RRPV_MAX - 1;
+}
+
+int srrip_victim(cache *this_cache, unsigned char *meta, int num_lines)
+{
+    int way;
+
+    for (;;) {
+        for (way = 0; way < num_lines; way++) {
+            if (meta[way] == RRPV_MAX) {
+                return way;
+            }
+        }
+        for (way = 0; way < num_lines; way++) {
+            meta[way]++;
+        }
+    }
+}
+
+/* lfu: each way's word counts its accesses since it was filled */
+void lfu_touch(cache *this_cache, unsigned char *meta, int way, int num_lines)
+{
+    ((unsigned long long *) meta)[way]++;
+}
+
+void lfu_fill(cache *this_cache, unsigned char *meta, int way, int num_lines)
+{
+    ((unsigned long long *) meta)[way] = 1;
+}
+
+int lfu_victim(cache *this_cache, unsigned char *meta, int num_lines)
+{
+    return min_word_way(meta, num_lines);
+}
+
+const replacement_policy replacement_policies[] = {
+    { "lru",    0, meta_word_per_way, stamp_way,  stamp_way,  oldest_way },
+    { "fifo",   0, meta_word_per_way, ignore_way, stamp_way,  oldest_way },
+    { "random", 0, meta_word_per_set, ignore_way, ignore_way, random_way },
+    { "plru",   1, meta_word_per_set, plru_touch, plru_touch, plru_victim },
+    { "srrip",  0, meta_byte_per_way, srrip_touch, srrip_fill, srrip_victim },
+    { "lfu",    0, meta_word_per_way, lfu_touch,  lfu_fill,   lfu_victim },
+};
+
+#define NUM_POLICIES ((int) (sizeof(replacement_policies) / sizeof(replacement_policies[0])))
+
+/* look up a policy by name, NULL if there is none */
+const replacement_policy *find_policy(const char *name)
+{
+    int i;
+
+    for (i = 0; i < NUM_POLICIES; i++) {
+        if (strcmp(replacement_policies[i].name, name) == 0) {
+            return &replacement_policies[i];
+        }
+    }
+    return NULL;
+} /* end find_policy */
+
+/* whether a policy can manage sets of num_lines lines */
+int policy_supports(const replacement_policy *policy, int num_lines)
+{
+    if (policy->pow2_ways) {
+        return num_lines <= 64 && (num_lines & (num_lines - 1)) == 0;
+    }
+    return 1;
+}
+
+/* scan ways first..num_lines-1 one at a time, the scalar reference lookup
+ * and the tail of the vector ones
+ */
+static inline int tag_lookup_ways(const mem_addr_t *tags, const unsigned char *valid, int first,
+                                  int num_lines, mem_addr_t tag, int *empty_index)
+{
+    int way;
+
+    for (way = first; way < num_lines; way++) {
+        if (valid[way]) {
+            if (tags[way] == tag) {
+                return way;
+            }
+        } else if (*empty_index < 0) {
+            *empty_index = way;
+        }
+    }
+    return -1;
+}
+
+int tag_lookup_scalar(const mem_addr_t *tags, const unsigned char *valid,
+                      int num_lines, mem_addr_t tag, int *empty_index)
+{
+    *empty_index = -1;
+    return tag_lookup_ways(tags, valid, 0, num_lines, tag, empty_index);
+}
+
+/* gather the 8 valid bytes (each 0 or 1) starting at valid into a bit mask,
+ * bit i set when way i is valid
+ */
+static inline unsigned int valid_mask8(const unsigned char *valid)
+{
+    unsigned long long bytes;
+    memcpy(&bytes, valid, sizeof(bytes));
+    return (unsigned int) (((bytes & 0x0101010101010101ULL) * 0x0102040810204080ULL) >> 56);
+}
+
+/* shared by the vector lookups: given the tag-match mask of 8 ways starting
+ * at way, return the hit way or update *empty_index from the valid mask
+ */
+static inline int lookup_masks8(unsigned int hits, const unsigned char *valid, int way, int *empty_index)
+{
+    unsigned int valid8 = valid_mask8(valid + way);
+
+    hits &= valid8;
+    if (hits) {
+        return way + __builtin_ctz(hits);
+    }
+    if (*empty_index < 0 && valid8 != 0xff) {
+        *empty_index = way + __builtin_ctz(~valid8);
+    }
+    return -1;
+}
+
+#ifdef CSIM_X86
+__attribute__((target("avx2")))
+int tag_lookup_avx2(const mem_addr_t *tags, const unsigned char *valid,
+                    int num_lines, mem_addr_t tag, int *empty_index)
+{
+    __m256i needle = _mm256_set1_epi64x((long long) tag);
+    int way;
+    int hit;
+
+    *empty_index = -1;
+    for (way = 0; way + 8 <= num_lines; way += 8) {
+        __m256i lo = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (tags + way)), needle);
+        __m256i hi = _mm256_cmpeq_epi64(_mm256_loadu_si256((const __m256i *) (tags + way + 4)), needle);
+        unsigned int hits = _mm256_movemask_pd(_mm256_castsi256_pd(lo)) |
+                            (_mm256_movemask_pd(_mm256_castsi256_pd(hi)) << 4);
+
+        if ((hit = lookup_masks8(hits, valid, way, empty_index)) >= 0) {
+            return hit;
+        }
+    }
+    return tag_lookup_ways(tags, valid, way, num_lines, tag, empty_index);
+}
+
+__attribute__((target("sse4.2")))
+int tag_lookup_sse4(const mem_addr_t *tags, const unsigned char *valid,
+                    int num_lines, mem_addr_t tag, int *empty_index)
+{
+    __m128i needle = _mm_set1_epi64x((long long) tag);
+    int way;
+    int hit;
+    int k;
+
+    *empty_index = -1;
+    for (way = 0; way + 8 <= num_lines; way += 8) {
+        unsigned int hits = 0;
+        for (k = 0; k < 8; k += 2) {
+            __m128i eq = _mm_cmpeq_epi64(_mm_loadu_si128((const __m128i *) (tags + way + k)), needle);
+            hits |= _mm_movemask_pd(_mm_castsi128_pd(eq)) << k;
+        }
+
+        if ((hit = lookup_masks8(hits, valid, way, empty_index)) >= 0) {
+            return hit;
+        }
+    }
+    return tag_lookup_ways(tags, valid, way, num_lines, tag, empty_index);
+}
+#endif
+
+#ifdef CSIM_NEON
+int tag_lookup_neon(const mem_addr_t *tags, const unsigned char *valid,
+                    int num_lines, mem_addr_t tag, int *empty_index)
+{
+    uint64x2_t needle = vdupq_n_u64(tag);
+    int way;
+    int hit;
+    int k;
+
+    *empty_index = -1;
+    for (way = 0; way + 8 <= num_lines; way += 8) {
+        unsigned int hits = 0;
+        for (k = 0; k < 8; k += 2) {
+            uint64x2_t eq = vceqq_u64(vld1q_u64((const uint64_t *) (tags + way + k)), needle);
+            hits |= (unsigned int) ((vgetq_lane_u64(eq, 0) & 1) | (vgetq_lane_u64(eq, 1) & 2)) << k;
+        }
+
+        if ((hit = lookup_masks8(hits, valid, way, empty_index)) >= 0) {
+            return hit;
+        }
+    }
+    return tag_lookup_ways(tags, valid, way, num_lines, tag, empty_index);
+}
+#endif
+
+/* pick a tag lookup by name ("auto" takes the widest the cpu supports).
+ * returns NULL if the name is unknown or not available on this machine
+ */
+tag_lookup_fn select_tag_lookup(const char *name)
+{
+    int pick_auto = (strcmp(name, "auto") == 0);
+
+#ifdef CSIM_X86
+    __builtin_cpu_init();
+    if ((pick_auto || strcmp(name, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        return tag_lookup_avx2;
+    }
+    if ((pick_auto || strcmp(name, "sse4") == 0) && __builtin_cpu_supports("sse4.2")) {
+        return tag_lookup_sse4;
+    }
+#endif
+#ifdef CSIM_NEON
+    if (pick_auto || strcmp(name, "neon") == 0) {
+        return tag_lookup_neon;
+    }
+#endif
+    if (pick_auto || strcmp(name, "scalar") == 0) {
+        return tag_lookup_scalar;
+    }
+    return NULL;
+} /* end select_tag_lookup */
+
+/* lookup used by simulate_cache() for sets of SIMD_MIN_WAYS or more lines */
+tag_lookup_fn tag_lookup = tag_lookup_scalar;
+
+/* one set of a cache, located from an address */
+typedef struct {
+    mem_addr_t *tags;
+    unsigned char *valid;
+    unsigned char *meta;
+    unsigned long long setIndex;
+    mem_addr_t tag;
+} set_ref;
+
+/* split address into set index and tag, and point at that set's lines */
+static inline void locate_set(const cache *this_cache, const cache_param_t *par, mem_addr_t address, set_ref *set)
+{
+        int num_lines = par->E;
+
+        int tag_size = (64 - (par->s + par->b));
+
+        unsigned long long temp = address << (tag_size);
+        set->setIndex = temp >> (tag_size + par->b);
+
+        set->tag = address >> (par->s + par->b);
+
+        /* the set's lines are contiguous in each array */
+        set->tags = this_cache->tags + set->setIndex * num_lines;
+        set->valid = this_cache->valid + set->setIndex * num_lines;
+        set->meta = this_cache->meta + set->setIndex * this_cache->meta_bytes;
+}
+
+/* way holding the set's tag or -1, with the first empty way in *empty_index */
+static inline int find_way(const set_ref *set, int num_lines, int *empty_index)
+{
+        /* wide sets compare their tags with vector instructions */
+        if (num_lines >= SIMD_MIN_WAYS) {
+            return tag_lookup(set->tags, set->valid, num_lines, set->tag, empty_index);
+        }
+        return tag_lookup_scalar(set->tags, set->valid, num_lines, set->tag, empty_index);
+}
+
+/* place the set's tag after a miss, evicting the policy's victim if the set is full.
+ * the way it went to is stored in *way
+ */
+static inline int fill_way(cache *this_cache, cache_param_t *par, const set_ref *set, int empty_index, int *way)
+{
+        int num_lines = par->E;
+        int result = CACHE_MISS;
+        int dirty;
+
+        if (empty_index < 0) { /* if there are no empty lines in cache, must overwrite */
+        
+            par->evictions++;
+            empty_index = this_cache->policy->victim(this_cache, set->meta, num_lines);
+
+            /* branch-free: whether the victim is dirty is close to random */
+            dirty = (set->valid[empty_index] & LINE_DIRTY) != 0;
+            par->dirty_evictions += dirty;
+            par->bytes_written += (long long) dirty << par->b;
+
+            /* rebuild the evicted block's address for the levels below */
+            this_cache->evicted = (set->tags[empty_index] << (par->s + par->b)) | (set->setIndex << par->b);
+            this_cache->evicted_flags = set->valid[empty_index];
+            result = CACHE_MISS_EVICT;
+        }
+
+        set->tags[empty_index] = set->tag;
+        set->valid[empty_index] = LINE_VALID;
+        this_cache->policy->fill(this_cache, set->meta, empty_index, num_lines);
+        *way = empty_index;
+        return result;
+}
+
+/* runs the trace simulation for one access and returns CACHE_HIT, CACHE_MISS
+ * or CACHE_MISS_EVICT.
+ * the tag lookup also reports the first empty line, so an access costs no
+ * allocation and no struct copies; the replacement policy only sees the
+ * set's own metadata
+ */
+int simulate_cache (cache *this_cache, cache_param_t *par, mem_addr_t address) {
+
+        set_ref set;
+        int hit_index;
+        int empty_index; /* first empty line in the set, if any */
+
+        locate_set(this_cache, par, address, &set);
+        hit_index = find_way(&set, par->E, &empty_index);
+
+        if (hit_index >= 0) { /* found the right tag - cache hit */
+            this_cache->policy->touch(this_cache, set.meta, hit_index, par->E);
+            par->hits++;
+            return CACHE_HIT; /* data was hit and is already in cache, exit function */
+        }
+
+        /* we didn't find a hit, so continue with cache miss
+         * evict the policy's victim, or write to the first empty line in this set
+         */
+        par->misses++; 
+        return fill_way(this_cache, par, &set, empty_index, &hit_index);
+
+} /* end simulate_cache */
+
+/* runs a store of size bytes through the cache's write policy, returns like
+ * simulate_cache(). with write-allocate a miss fills the line as a load does;
+ * without it the line is left alone and the store only goes to memory
+ */
+int simulate_store (cache *this_cache, cache_param_t *par, mem_addr_t address, int size) {
+
+        set_ref set;
+        int hit_index;
+        int empty_index;
+        int result = CACHE_HIT;
+
+        locate_set(this_cache, par, address, &set);
+        hit_index = find_way(&set, par->E, &empty_index);
+
+        if (hit_index >= 0) {
+            this_cache->policy->touch(this_cache, set.meta, hit_index, par->E);
+            par->hits++;
+        } else {
+            par->misses++;
+            if (!this_cache->write_allocate) {
+                par->bytes_written += size;
+                return CACHE_MISS;
+            }
+            result = fill_way(this_cache, par, &set, empty_index, &hit_index);
+        }
+
+        if (this_cache->write_through) {
+            par->bytes_written += size;
+        } else {
+            set.valid[hit_index] |= LINE_DIRTY;
+        }
+        return result;
+
+} /* end simulate_store */
+
+/* apply WRITE_* flags to a cache */
+void set_write_policy(cache *this_cache, int write_mode)
+{
+    this_cache->write_through = (write_mode & WRITE_THROUGH) != 0;
+    this_cache->write_allocate = (write_mode & WRITE_NO_ALLOCATE) == 0;
+}
+
+/* parse a -W mode: wb-wa, wb-nwa, wt-wa or wt-nwa. returns WRITE_* flags or -1 */
+int parse_write_mode(const char *name)
+{
+    static const char *modes[] = { "wb-wa", "wt-wa", "wb-nwa", "wt-nwa" };
+    int mode;
+
+    for (mode = 0; mode < 4; mode++) {
+        if (strcmp(name, modes[mode]) == 0) {
+            return mode;
+        }
+    }
+    return -1;
+} /* end parse_write_mode */
+
+/* the extended summary -W adds under printSummary()'s line */
+void printWriteSummary(const cache_param_t *par)
+{
+    printf("dirty_evictions:%d bytes_written:%lld\n", par->dirty_evictions, par->bytes_written);
+}
+
+/* the cache csim_trace.h's accessors feed while a capture is running */
+cache csim_trace_cache;
+cache_param_t csim_trace_par;
+const char *csim_trace_base;
+int csim_trace_on;
+
+int csim_trace_begin(int s, int E, int b, const replacement_policy *policy, int write_mode, const void *base)
+{
+    if (!policy_supports(policy, E)) {
+        return -1;
+    }
+    bzero(&csim_trace_par, sizeof(csim_trace_par));
+    csim_trace_par.s = s;
+    csim_trace_par.E = E;
+    csim_trace_par.b = b;
+    csim_trace_par.S = 1 << s;
+    csim_trace_par.B = 1 << b;
+    csim_trace_cache = build_cache(bit_pow(s), E, bit_pow(b), policy);
+    set_write_policy(&csim_trace_cache, write_mode);
+    csim_trace_base = (const char *) base;
+    csim_trace_on = 1;
+    return 0;
+} /* end csim_trace_begin */
+
+void csim_trace_end(cache_param_t *counts)
+{
+    csim_trace_on = 0;
+    *counts = csim_trace_par;
+    clear_cache(csim_trace_cache, bit_pow(csim_trace_par.s), csim_trace_par.E, bit_pow(csim_trace_par.b));
+}
+
+/* look up address without allocating on a miss. a hit is counted and the
+ * line is handed to the level above, i.e. invalidated here (exclusive levels)
+ */
+int extract_block(cache *this_cache, cache_param_t *par, mem_addr_t address)
+{
+    set_ref set;
+    int empty_index;
+    int hit_index;
+
+    locate_set(this_cache, par, address, &set);
+    hit_index = find_way(&set, par->E, &empty_index);
+
+    if (hit_index < 0) {
+        par->misses++;
+        return CACHE_MISS;
+    }
+    par->hits++;
+    set.valid[hit_index] = 0;
+    return CACHE_HIT;
+} /* end extract_block */
+
+/* place a victim from the level above without counting a hit or miss.
+ * returns CACHE_MISS_EVICT if that pushed another block out
+ */
+int install_block(cache *this_cache, cache_param_t *par, mem_addr_t address)
+{
+    set_ref set;
+    int empty_index;
+    int hit_index;
+
+    locate_set(this_cache, par, address, &set);
+    hit_index = find_way(&set, par->E, &empty_index);
+
+    if (hit_index >= 0) {
+        this_cache->policy->touch(this_cache, set.meta, hit_index, par->E);
+        return CACHE_HIT;
+    }
+    return fill_way(this_cache, par, &set, empty_index, &hit_index);
+} /* end install_block */
+
+/* drop address from a cache if it is there, returns 1 if it was */
+int invalidate_block(cache *this_cache, cache_param_t *par, mem_addr_t address)
+{
+    set_ref set;
+    int empty_index;
+    int hit_index;
+
+    locate_set(this_cache, par, address, &set);
+    hit_index = find_way(&set, par->E, &empty_index);
+
+    if (hit_index < 0) {
+        return 0;
+    }
+    set.valid[hit_index] = 0;
+    return 1;
+} /* end invalidate_block */
+
+/* one access through a hierarchy. the demand lookup walks down until a level
+ * hits, then every level's victim is handled from the top: an inclusive level
+ * back-invalidates it above, and an exclusive level below receives it (which
+ * may in turn evict from that level)
+ */
+void simulate_hierarchy(cache_level *levels, int num_levels, mem_addr_t address)
+{
+    mem_addr_t victims[MAX_LEVELS];
+    int has_victim[MAX_LEVELS];
+    int i, j;
+
+    for (i = 0; i < num_levels; i++) {
+        has_victim[i] = 0;
+    }
+
+    for (i = 0; i < num_levels; i++) {
+        cache_level *level = &levels[i];
+        int result;
+
+        if (level->inclusion == INCLUSION_EXCLUSIVE) {
+            result = extract_block(&level->level_cache, &level->par, address);
+        } else {
+            result = simulate_cache(&level->level_cache, &level->par, address);
+        }
+
+        if (result == CACHE_MISS_EVICT) {
+            victims[i] = level->level_cache.evicted;
+            has_victim[i] = 1;
+        }
+        if (result == CACHE_HIT) {
+            break;
+        }
+    }
+
+    for (i = 0; i < num_levels; i++) {
+        if (!has_victim[i]) {
+            continue;
+        }
+        if (levels[i].inclusion == INCLUSION_INCLUSIVE) {
+            for (j = 0; j < i; j++) {
+                invalidate_block(&levels[j].level_cache, &levels[j].par, victims[i]);
+            }
+        }
+        if (i + 1 < num_levels && levels[i + 1].inclusion == INCLUSION_EXCLUSIVE) {
+            if (install_block(&levels[i + 1].level_cache, &levels[i + 1].par, victims[i]) == CACHE_MISS_EVICT) {
+                victims[i + 1] = levels[i + 1].level_cache.evicted;
+                has_victim[i + 1] = 1;
+            }
+        }
+    }
+} /* end simulate_hierarchy */
+
+/* instead of explicitly defining similar to pow(2.0, exp), just bit shift */
+long long bit_pow(int power) {
+    long long result = 1;
+    result = result << power;
+    return result;
+} 
+
+/* decode a little-endian integer of num_bytes bytes */
+static inline unsigned long long load_le(const unsigned char *bytes, int num_bytes)
+{
+    unsigned long long value = 0;
+    int i;
+    for (i = num_bytes - 1; i >= 0; i--) {
+        value = (value << 8) | bytes[i];
+    }
+    return value;
+}
+
+/* if the available bytes start with the binary header, consume it and
+ * switch the reader into binary mode. returns -1 on an unsupported version
+ */
+int read_trace_header(trace_reader *reader)
+{
+    const unsigned char *header = (const unsigned char *) reader->data;
+
+    if (reader->len < TRACE_HEADER_SIZE || memcmp(header, TRACE_MAGIC, TRACE_MAGIC_LEN) != 0) {
+        return 0; /* plain text trace */
+    }
+
+    if (load_le(header + 8, 4) != TRACE_VERSION) {
+        return -1;
+    }
+
+    reader->binary = 1;
+    reader->delta = (load_le(header + 12, 4) & TRACE_FLAG_DELTA) != 0;
+    reader->pos = TRACE_HEADER_SIZE;
+    return 0;
+} /* end read_trace_header */
+
+/* TRACE_GZIP or TRACE_ZSTD if bytes start like a compressed stream, else 0 */
+int trace_compression(const unsigned char *bytes, size_t len)
+{
+    if (len >= 2 && bytes[0] == 0x1f && bytes[1] == 0x8b) {
+        return TRACE_GZIP;
+    }
+    if (len >= 4 && load_le(bytes, 4) == 0xfd2fb528) {
+        return TRACE_ZSTD;
+    }
+    return 0;
+}
+
+/* set the stream up for format, returns -1 if this build can't decompress it */
+int inflate_stream_init(inflate_stream *stream, int format)
+{
+    bzero(stream, sizeof(*stream));
+    stream->format = format;
+#ifdef CSIM_ZLIB
+    if (format == TRACE_GZIP) {
+        return inflateInit2(&stream->zs, 15 + 16) == Z_OK ? 0 : -1; /* 16: expect a gzip wrapper */
+    }
+#endif
+#ifdef CSIM_ZSTD
+    if (format == TRACE_ZSTD) {
+        stream->zds = ZSTD_createDStream();
+        return (stream->zds != NULL && !ZSTD_isError(ZSTD_initDStream(stream->zds))) ? 0 : -1;
+    }
+#endif
+    return -1;
+}
+
+/* start over on a new run of frames */
+void inflate_stream_reset(inflate_stream *stream)
+{
+#ifdef CSIM_ZLIB
+    if (stream->format == TRACE_GZIP) {
+        inflateReset(&stream->zs);
+    }
+#endif
+#ifdef CSIM_ZSTD
+    if (stream->format == TRACE_ZSTD) {
+        ZSTD_initDStream(stream->zds);
+    }
+#endif
+}
+
+void inflate_stream_end(inflate_stream *stream)
+{
+#ifdef CSIM_ZLIB
+    if (stream->format == TRACE_GZIP) {
+        inflateEnd(&stream->zs);
+    }
+#endif
+#ifdef CSIM_ZSTD
+    if (stream->format == TRACE_ZSTD) {
+        ZSTD_freeDStream(stream->zds);
+    }
+#endif
+}
+
+/* decompress from *in into out until out is full or no more progress is
+ * possible, running on through concatenated members and frames. advances
+ * *in and *in_len, returns the bytes written, or -1 once only corrupt
+ * input is left
+ */
+long inflate_stream_run(inflate_stream *stream, const unsigned char **in, size_t *in_len, char *out, size_t out_len)
+{
+    size_t written = 0;
+
+    if (stream->failed) {
+        return -1;
+    }
+
+#ifdef CSIM_ZLIB
+    if (stream->format == TRACE_GZIP) {
+        z_stream *zs = &stream->zs;
+        zs->next_in = (unsigned char *) *in;
+        zs->next_out = (unsigned char *) out;
+        while (written < out_len) {
+            uInt in_chunk = (*in_len > (1U << 30)) ? (1U << 30) : (uInt) *in_len;
+            uInt out_chunk = (out_len - written > (1U << 30)) ? (1U << 30) : (uInt) (out_len - written);
+            int ret;
+
+            zs->avail_in = in_chunk;
+            zs->avail_out = out_chunk;
+            ret = inflate(zs, Z_NO_FLUSH);
+            *in_len -= in_chunk - zs->avail_in;
+            written += out_chunk - zs->avail_out;
+            if (ret == Z_STREAM_END) {
+                inflateReset(zs); /* another member may follow */
+            } else if (ret == Z_BUF_ERROR) {
+                break;
+            } else if (ret != Z_OK) {
+                stream->failed = 1;
+                break;
+            }
+            if (in_chunk == zs->avail_in && out_chunk == zs->avail_out && ret != Z_STREAM_END) {
+                break;
+            }
+        }
+        *in = zs->next_in;
+        return (written == 0 && stream->failed) ? -1 : (long) written;
+    }
+#endif
+#ifdef CSIM_ZSTD
+    if (stream->format == TRACE_ZSTD) {
+        ZSTD_inBuffer input = { *in, *in_len, 0 };
+        ZSTD_outBuffer output = { out, out_len, 0 };
+        while (output.pos < output.size) {
+            size_t in_before = input.pos;
+            size_t out_before = output.pos;
+            if (ZSTD_isError(ZSTD_decompressStream(stream->zds, &output, &input))) {
+                stream->failed = 1;
+                break;
+            }
+            if (input.pos == in_before && output.pos == out_before) {
+                break;
+            }
+        }
+        *in += input.pos;
+        *in_len -= input.pos;
+        return (output.pos == 0 && stream->failed) ? -1 : (long) output.pos;
+    }
+#endif
+    (void) in;
+    (void) in_len;
+    (void) out;
+    (void) out_len;
+    (void) written;
+    return -1;
+}
+
+/* size of the frame at bytes if it can be found without decompressing:
+ * any zstd frame, or a bgzip block (gzip member with a BC extra field).
+ * returns 0 otherwise
+ */
+size_t frame_size(int format, const unsigned char *bytes, size_t len)
+{
+#ifdef CSIM_ZSTD
+    if (format == TRACE_ZSTD) {
+        size_t size = ZSTD_findFrameCompressedSize(bytes, len);
+        return ZSTD_isError(size) ? 0 : size;
+    }
+#endif
+    if (format == TRACE_GZIP && len >= 18 && bytes[0] == 0x1f && bytes[1] == 0x8b && (bytes[3] & 4)) {
+        size_t extra_len = load_le(bytes + 10, 2);
+        size_t pos = 12;
+
+        while (pos + 4 <= 12 + extra_len && pos + 4 <= len) {
+            size_t field_len = load_le(bytes + pos + 2, 2);
+            if (bytes[pos] == 'B' && bytes[pos + 1] == 'C' && field_len == 2 && pos + 6 <= len) {
+                size_t size = load_le(bytes + pos + 4, 2) + 1;
+                return size <= len ? size : 0;
+            }
+            pos += 4 + field_len;
+        }
+    }
+    return 0;
+}
+
+/* cut the mapping into jobs of whole frames, at least INFLATE_JOB_BYTES
+ * each. returns the number of jobs, or 0 if the frames can't all be found
+ */
+int find_inflate_jobs(trace_inflater *inflater)
+{
+    size_t pos = 0;
+    size_t start = 0;
+    int capacity = 16;
+
+    inflater->jobs = (inflate_job *) malloc(sizeof(inflate_job) * capacity);
+    inflater->num_jobs = 0;
+    while (pos < inflater->input_len) {
+        size_t size = frame_size(inflater->stream.format, inflater->input + pos, inflater->input_len - pos);
+        if (size == 0) {
+            free(inflater->jobs);
+            inflater->jobs = NULL;
+            return 0;
+        }
+        pos += size;
+        if (pos - start >= INFLATE_JOB_BYTES || pos == inflater->input_len) {
+            if (inflater->num_jobs == capacity) {
+                capacity *= 2;
+                inflater->jobs = (inflate_job *) realloc(inflater->jobs, sizeof(inflate_job) * capacity);
+            }
+            bzero(&inflater->jobs[inflater->num_jobs], sizeof(inflate_job));
+            inflater->jobs[inflater->num_jobs].start = start;
+            inflater->jobs[inflater->num_jobs].end = pos;
+            inflater->num_jobs++;
+            start = pos;
+        }
+    }
+    return inflater->num_jobs;
+} /* end find_inflate_jobs */
+
+/* decompress one job into a buffer that grows as needed.
+ * returns the job's new state, 1 or -1 if it was corrupt
+ */
+int run_inflate_job(inflate_stream *stream, const trace_inflater *inflater, inflate_job *job)
+{
+    const unsigned char *in = inflater->input + job->start;
+    size_t in_len = job->end - job->start;
+    size_t capacity = in_len * 4 + 4096;
+    long n;
+
+    stream->failed = 0;
+    inflate_stream_reset(stream);
+    job->data = (char *) malloc(capacity);
+    job->len = 0;
+    for (;;) {
+        n = inflate_stream_run(stream, &in, &in_len, job->data + job->len, capacity - job->len);
+        if (n < 0) {
+            return -1;
+        }
+        job->len += n;
+        if (stream->failed) {
+            return -1; /* the scanner still gets what decoded, then stops */
+        }
+        if (job->len < capacity) {
+            break; /* output had room, so the input is used up */
+        }
+        capacity *= 2;
+        job->data = (char *) realloc(job->data, capacity);
+    }
+    return 1;
+} /* end run_inflate_job */
+
+/* worker: take the next job while it is within the window of the scanner */
+void *inflate_worker_main(void *arg)
+{
+    trace_inflater *inflater = (trace_inflater *) arg;
+    inflate_stream stream;
+    int ready = (inflate_stream_init(&stream, inflater->stream.format) == 0);
+
+    pthread_mutex_lock(&inflater->lock);
+    for (;;) {
+        int state = -1;
+        int k;
+
+        while (!inflater->stop && inflater->next_job < inflater->num_jobs &&
+               inflater->next_job > inflater->reading + inflater->window) {
+            pthread_cond_wait(&inflater->changed, &inflater->lock);
+        }
+        if (inflater->stop || inflater->next_job == inflater->num_jobs) {
+            break;
+        }
+        k = inflater->next_job++;
+        pthread_mutex_unlock(&inflater->lock);
+
+        if (ready) {
+            state = run_inflate_job(&stream, inflater, &inflater->jobs[k]);
+        }
+
+        /* the scanner only looks at the job's buffer once state is set */
+        pthread_mutex_lock(&inflater->lock);
+        inflater->jobs[k].state = state;
+        pthread_cond_broadcast(&inflater->changed);
+    }
+    pthread_mutex_unlock(&inflater->lock);
+
+    if (ready) {
+        inflate_stream_end(&stream);
+    }
+    return NULL;
+} /* end inflate_worker_main */
+
+/* hand the scanner the next decompressed job, in trace order.
+ * returns 0 once the trace is exhausted or after a corrupt job
+ */
+int next_inflate_job(trace_reader *reader)
+{
+    trace_inflater *inflater = reader->inflater;
+    inflate_job *job;
+
+    pthread_mutex_lock(&inflater->lock);
+    if (inflater->reading >= 0) {
+        job = &inflater->jobs[inflater->reading];
+        free(job->data);
+        job->data = NULL;
+        job->len = 0;
+        if (job->state < 0) {
+            pthread_mutex_unlock(&inflater->lock);
+            return 0;
+        }
+    }
+    inflater->reading++;
+    pthread_cond_broadcast(&inflater->changed);
+    if (inflater->reading == inflater->num_jobs) {
+        pthread_mutex_unlock(&inflater->lock);
+        return 0;
+    }
+    job = &inflater->jobs[inflater->reading];
+    while (job->state == 0) {
+        pthread_cond_wait(&inflater->changed, &inflater->lock);
+    }
+    pthread_mutex_unlock(&inflater->lock);
+
+    /* a corrupt job still hands over what decoded before the damage */
+    reader->data = job->data;
+    reader->len = job->len;
+    reader->pos = 0;
+    return 1;
+} /* end next_inflate_job */
+
+/* refill the reader with decompressed bytes, returns 0 at the end of the trace */
+int refill_inflated(trace_reader *reader)
+{
+    trace_inflater *inflater = reader->inflater;
+    size_t filled = 0;
+
+    if (inflater->jobs != NULL) {
+        while (next_inflate_job(reader)) {
+            if (reader->len > 0) {
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    while (filled < TRACE_CHUNK_SIZE) {
+        const unsigned char *in;
+        size_t in_len;
+        long n;
+
+        if (inflater->input_pos == inflater->input_len && !inflater->input_eof) {
+            ssize_t got;
+            do {
+                got = read(reader->fd, inflater->in_buf, TRACE_CHUNK_SIZE);
+            } while (got < 0 && errno == EINTR);
+            inflater->input = inflater->in_buf;
+            inflater->input_len = (got > 0) ? got : 0;
+            inflater->input_pos = 0;
+            inflater->input_eof = (got <= 0);
+        }
+
+        in = inflater->input + inflater->input_pos;
+        in_len = inflater->input_len - inflater->input_pos;
+        n = inflate_stream_run(&inflater->stream, &in, &in_len, reader->buf + filled, TRACE_CHUNK_SIZE - filled);
+        if (n < 0) {
+            inflater->input_eof = 1; /* corrupt: stop here, like the scanner does */
+            inflater->input_pos = inflater->input_len;
+            break;
+        }
+        filled += n;
+
+        /* no output and no input taken means the stream can't go on */
+        if (n == 0 && in_len == inflater->input_len - inflater->input_pos && inflater->input_eof) {
+            break;
+        }
+        inflater->input_pos = inflater->input_len - in_len;
+    }
+
+    reader->data = reader->buf;
+    reader->len = filled;
+    reader->pos = 0;
+    return filled > 0;
+} /* end refill_inflated */
+
+/* put a gzip or zstd trace behind the reader: input is the whole mapped
+ * file (map != NULL), or the first in_len bytes read from reader->fd.
+ * fills the reader with the first decompressed bytes; returns -1 if this
+ * build can't decompress format
+ */
+int open_inflater(trace_reader *reader, int format, void *map, const void *input, size_t in_len)
+{
+    trace_inflater *inflater = (trace_inflater *) calloc(1, sizeof(trace_inflater));
+    int k;
+
+    if (inflater == NULL || inflate_stream_init(&inflater->stream, format) < 0) {
+        fprintf(stderr, "csim: %s traces need a build with %s\n",
+                format == TRACE_GZIP ? "gzip" : "zstd",
+                format == TRACE_GZIP ? "-DCSIM_ZLIB ... -lz" : "-DCSIM_ZSTD ... -lzstd");
+        free(inflater);
+        return -1;
+    }
+    reader->inflater = inflater;
+    reader->eof = 0;
+    reader->len = 0;
+    reader->pos = 0;
+    inflater->reading = -1;
+    pthread_mutex_init(&inflater->lock, NULL);
+    pthread_cond_init(&inflater->changed, NULL);
+
+    if (map != NULL) {
+        inflater->map = map;
+        inflater->map_len = in_len;
+        inflater->input = (const unsigned char *) map;
+        inflater->input_len = in_len;
+        inflater->input_eof = 1;
+    } else {
+        inflater->in_buf = (unsigned char *) malloc(TRACE_CHUNK_SIZE);
+        memcpy(inflater->in_buf, input, in_len);
+        inflater->input = inflater->in_buf;
+        inflater->input_len = in_len;
+    }
+
+    /* independent frames are worth fanning out over the cores */
+    if (map != NULL && find_inflate_jobs(inflater) > 1) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        inflater->num_threads = (cores < 1) ? 1 : (cores > INFLATE_MAX_THREADS) ? INFLATE_MAX_THREADS : (int) cores;
+        inflater->window = 2 * inflater->num_threads;
+        for (k = 0; k < inflater->num_threads; k++) {
+            if (pthread_create(&inflater->threads[k], NULL, inflate_worker_main, inflater) != 0) {
+                break;
+            }
+        }
+        inflater->num_threads = k;
+    }
+    if (inflater->jobs != NULL && inflater->num_threads == 0) {
+        free(inflater->jobs);
+        inflater->jobs = NULL;
+    }
+    if (inflater->jobs == NULL && reader->buf == NULL) {
+        reader->buf = (char *) malloc(TRACE_CHUNK_SIZE);
+    }
+
+    if (!refill_inflated(reader)) {
+        reader->eof = 1;
+    }
+    return 0;
+} /* end open_inflater */
+
+/* stop the workers and release everything the inflater holds */
+void close_inflater(trace_inflater *inflater)
+{
+    int k;
+
+    pthread_mutex_lock(&inflater->lock);
+    inflater->stop = 1;
+    pthread_cond_broadcast(&inflater->changed);
+    pthread_mutex_unlock(&inflater->lock);
+    for (k = 0; k < inflater->num_threads; k++) {
+        pthread_join(inflater->threads[k], NULL);
+    }
+    for (k = 0; inflater->jobs != NULL && k < inflater->num_jobs; k++) {
+        free(inflater->jobs[k].data);
+    }
+    free(inflater->jobs);
+    inflate_stream_end(&inflater->stream);
+    pthread_mutex_destroy(&inflater->lock);
+    pthread_cond_destroy(&inflater->changed);
+    if (inflater->map != NULL) {
+        munmap(inflater->map, inflater->map_len);
+    }
+    free(inflater->in_buf);
+    free(inflater);
+} /* end close_inflater */
+
+/* open a trace for reading; "-" means stdin.
+ * returns 0 on success, -1 if the file could not be opened or
+ * carries a binary header of an unknown version
+ */
+int open_trace_input(trace_reader *reader, const char *trace_file)
+{
+    struct stat st;
+    int format;
+
+    bzero(reader, sizeof(*reader));
+
+    if (strcmp(trace_file, "-") == 0) {
+        reader->fd = STDIN_FILENO;
+    } else {
+        reader->fd = open(trace_file, O_RDONLY);
+        if (reader->fd < 0) {
+            return -1;
+        }
+    }
+
+    /* regular files are mapped whole, so the scanner never has to refill */
+    if (fstat(reader->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, reader->fd, 0);
+        if (map != MAP_FAILED) {
+            format = trace_compression((const unsigned char *) map, st.st_size);
+            madvise(map, st.st_size, MADV_SEQUENTIAL);
+            if (format != 0) {
+                if (open_inflater(reader, format, map, map, st.st_size) < 0) {
+                    munmap(map, st.st_size);
+                    return -1;
+                }
+                return read_trace_header(reader);
+            }
+            reader->data = (const char *) map;
+            reader->len = st.st_size;
+            reader->mapped = 1;
+            reader->eof = 1;
+            return read_trace_header(reader);
+        }
+    }
+
+    /* otherwise stream the trace through a chunk buffer */
+    reader->buf = (char *) malloc(TRACE_CHUNK_SIZE);
+    if (reader->buf == NULL) {
+        return -1;
+    }
+    reader->data = reader->buf;
+
+    /* pipes may hand out short reads, so gather enough bytes to check the magic */
+    while (reader->len < TRACE_HEADER_SIZE) {
+        ssize_t n = read(reader->fd, reader->buf + reader->len, TRACE_CHUNK_SIZE - reader->len);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            reader->eof = 1;
+            break;
+        }
+        reader->len += n;
+    }
+
+    /* the bytes read so far are the start of the compressed stream */
+    format = trace_compression((const unsigned char *) reader->buf, reader->len);
+    if (format != 0 && open_inflater(reader, format, NULL, reader->buf, reader->len) < 0) {
+        return -1;
+    }
+    return read_trace_header(reader);
+} /* end open_trace_input */
+
+/* release the mapping or chunk buffer and close the trace */
+void close_trace(trace_reader *reader)
+{
+    trace_ring *ring = reader->ring;
+
+    /* the reader thread may be waiting for room if we stopped early */
+    if (ring != NULL) {
+        pthread_mutex_lock(&ring->lock);
+        ring->stop = 1;
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->lock);
+        pthread_join(ring->thread, NULL);
+        pthread_mutex_destroy(&ring->lock);
+        pthread_cond_destroy(&ring->changed);
+        free(ring->records);
+        free(ring);
+        reader->ring = NULL;
+    }
+    if (reader->inflater != NULL) {
+        close_inflater(reader->inflater);
+        reader->inflater = NULL;
+    }
+
+    if (reader->mapped) {
+        munmap((void *) reader->data, reader->len);
+    }
+    if (reader->buf != NULL) {
+        free(reader->buf);
+    }
+    if (reader->fd != STDIN_FILENO) {
+        close(reader->fd);
+    }
+} /* end close_trace */
+
+/* read the next chunk of a streamed trace, returns 0 once the input is exhausted */
+int refill_trace(trace_reader *reader)
+{
+    ssize_t n;
+
+    if (reader->eof) {
+        return 0;
+    }
+    if (reader->inflater != NULL) {
+        reader->eof = !refill_inflated(reader);
+        return !reader->eof;
+    }
+
+    do {
+        n = read(reader->fd, reader->buf, TRACE_CHUNK_SIZE);
+    } while (n < 0 && errno == EINTR);
+
+    if (n <= 0) {
+        reader->eof = 1;
+        return 0;
+    }
+
+    reader->len = n;
+    reader->pos = 0;
+    return 1;
+} /* end refill_trace */
+
+/* look at the next byte of the trace without consuming it, -1 at end of input */
+static inline int peek_trace(trace_reader *reader)
+{
+    if (reader->pos == reader->len && !refill_trace(reader)) {
+        return -1;
+    }
+    return (unsigned char) reader->data[reader->pos];
+}
+
+/* skip whitespace the same way a ' ' in a scanf format does */
+static inline void skip_space(trace_reader *reader)
+{
+    int ch;
+    while ((ch = peek_trace(reader)) == ' ' || (ch >= '\t' && ch <= '\r')) {
+        reader->pos++;
+    }
+}
+
+/* value of a hex digit, or -1 if ch is not one */
+static inline int hex_value(int ch)
+{
+    if (ch >= '0' && ch <= '9') {
+        return ch - '0';
+    }
+    ch |= 0x20; /* fold to lower case */
+    if (ch >= 'a' && ch <= 'f') {
+        return ch - 'a' + 10;
+    }
+    return -1;
+}
+
+/* decode the next " %c %llx,%d" record from a text trace.
+ * returns 1 if a full record was read, 0 at end of input or on a malformed record
+ */
+int next_text_record(trace_reader *reader, trace_record *record)
+{
+    int ch;
+    int digit;
+    int negative = 0;
+    int num_digits = 0;
+    mem_addr_t address = 0;
+    int size = 0;
+
+    /* " %c" */
+    skip_space(reader);
+    if ((ch = peek_trace(reader)) < 0) {
+        return 0;
+    }
+    record->op = (char) ch;
+    reader->pos++;
+
+    /* " %llx", with the optional 0x prefix scanf accepts */
+    skip_space(reader);
+    if (peek_trace(reader) == '0') {
+        reader->pos++;
+        num_digits = 1;
+        if ((peek_trace(reader) | 0x20) == 'x') {
+            reader->pos++;
+        }
+    }
+    while ((ch = peek_trace(reader)) >= 0 && (digit = hex_value(ch)) >= 0) {
+        address = (address << 4) | digit;
+        reader->pos++;
+        num_digits++;
+    }
+    if (num_digits == 0) {
+        return 0;
+    }
+
+    /* "," must follow the address directly */
+    if (peek_trace(reader) != ',') {
+        return 0;
+    }
+    reader->pos++;
+
+    /* "%d" */
+    skip_space(reader);
+    ch = peek_trace(reader);
+    if (ch == '-' || ch == '+') {
+        negative = (ch == '-');
+        reader->pos++;
+    }
+    num_digits = 0;
+    while ((ch = peek_trace(reader)) >= '0' && ch <= '9') {
+        size = size * 10 + (ch - '0');
+        reader->pos++;
+        num_digits++;
+    }
+    if (num_digits == 0) {
+        return 0;
+    }
+
+    record->address = address;
+    record->size = negative ? -size : size;
+    return 1;
+} /* end next_text_record */
+
+/* decode the next record of a binary trace.
+ * returns 1 if a full record was read, 0 at end of input or on a truncated record
+ */
+int next_binary_record(trace_reader *reader, trace_record *record)
+{
+    unsigned char bytes[TRACE_RECORD_SIZE];
+    unsigned long long zigzag = 0;
+    int shift = 0;
+    int ch;
+    int i;
+
+    /* fast path: a whole fixed-width record is already in memory */
+    if (!reader->delta && reader->len - reader->pos >= TRACE_RECORD_SIZE) {
+        const unsigned char *p = (const unsigned char *) reader->data + reader->pos;
+        record->op = (char) p[0];
+        record->size = p[1];
+        record->address = load_le(p + 2, 8);
+        reader->pos += TRACE_RECORD_SIZE;
+        return 1;
+    }
+
+    /* op and size bytes, possibly split across chunks */
+    for (i = 0; i < 2; i++) {
+        if ((ch = peek_trace(reader)) < 0) {
+            return 0;
+        }
+        bytes[i] = (unsigned char) ch;
+        reader->pos++;
+    }
+    record->op = (char) bytes[0];
+    record->size = bytes[1];
+
+    if (!reader->delta) {
+        for (i = 0; i < 8; i++) {
+            if ((ch = peek_trace(reader)) < 0) {
+                return 0;
+            }
+            bytes[i] = (unsigned char) ch;
+            reader->pos++;
+        }
+        record->address = load_le(bytes, 8);
+        return 1;
+    }
+
+    /* varint: 7 bits per byte, high bit set on every byte but the last */
+    do {
+        if ((ch = peek_trace(reader)) < 0 || shift > 63) {
+            return 0;
+        }
+        reader->pos++;
+        zigzag |= (unsigned long long) (ch & 0x7f) << shift;
+        shift += 7;
+    } while (ch & 0x80);
+
+    /* undo the zigzag mapping (0, -1, 1, -2, ... -> 0, 1, 2, 3, ...) */
+    reader->prev_address += (zigzag >> 1) ^ (~(zigzag & 1) + 1);
+    record->address = reader->prev_address;
+    return 1;
+} /* end next_binary_record */
+
+/* decode the next record of either trace format */
+static inline int decode_record(trace_reader *reader, trace_record *record)
+{
+    if (reader->binary) {
+        return next_binary_record(reader, record);
+    }
+    return next_text_record(reader, record);
+}
+
+/* reader thread: decode batches into the ring until the trace ends */
+void *trace_ring_main(void *arg)
+{
+    trace_reader *reader = (trace_reader *) arg;
+    trace_ring *ring = reader->ring;
+    unsigned long long tail = 0;
+    int count;
+    int stop;
+
+    do {
+        trace_record *batch = ring->records + (tail % TRACE_RING_BATCHES) * TRACE_RING_BATCH;
+
+        pthread_mutex_lock(&ring->lock);
+        while (tail - ring->head == TRACE_RING_BATCHES && !ring->stop) {
+            pthread_cond_wait(&ring->changed, &ring->lock);
+        }
+        stop = ring->stop;
+        pthread_mutex_unlock(&ring->lock);
+        if (stop) {
+            break;
+        }
+
+        /* the consumer never looks past tail, so the batch is ours to fill */
+        for (count = 0; count < TRACE_RING_BATCH; count++) {
+            if (!decode_record(reader, &batch[count])) {
+                break;
+            }
+        }
+
+        pthread_mutex_lock(&ring->lock);
+        ring->counts[tail % TRACE_RING_BATCHES] = count;
+        ring->tail = ++tail;
+        ring->done = (count < TRACE_RING_BATCH);
+        pthread_cond_broadcast(&ring->changed);
+        pthread_mutex_unlock(&ring->lock);
+    } while (count == TRACE_RING_BATCH);
+
+    return NULL;
+} /* end trace_ring_main */
+
+/* consumer: release the drained batch and wait for the next one.
+ * returns 0 once the trace is exhausted
+ */
+int next_ring_batch(trace_ring *ring)
+{
+    pthread_mutex_lock(&ring->lock);
+    if (ring->current != NULL) {
+        ring->head++;
+        pthread_cond_broadcast(&ring->changed);
+    }
+    while (ring->head == ring->tail && !ring->done) {
+        pthread_cond_wait(&ring->changed, &ring->lock);
+    }
+    if (ring->head == ring->tail) {
+        ring->current = NULL;
+        pthread_mutex_unlock(&ring->lock);
+        return 0;
+    }
+    ring->current = ring->records + (ring->head % TRACE_RING_BATCHES) * TRACE_RING_BATCH;
+    ring->current_count = ring->counts[ring->head % TRACE_RING_BATCHES];
+    ring->current_pos = 0;
+    pthread_mutex_unlock(&ring->lock);
+    return ring->current_count > 0;
+} /* end next_ring_batch */
+
+/* the next record of the trace, from the ring for streamed input */
+static inline int next_record(trace_reader *reader, trace_record *record)
+{
+    trace_ring *ring = reader->ring;
+
+    if (ring == NULL) {
+        return decode_record(reader, record);
+    }
+    if (ring->current_pos == ring->current_count && !next_ring_batch(ring)) {
+        return 0;
+    }
+    *record = ring->current[ring->current_pos++];
+    return 1;
+}
+
+/* open a trace for next_record(). streamed input gets a reader thread
+ * decoding ahead of the simulation; returns -1 if it can't be opened
+ */
+int open_trace(trace_reader *reader, const char *trace_file)
+{
+    trace_ring *ring;
+
+    if (open_trace_input(reader, trace_file) < 0) {
+        return -1;
+    }
+    if (reader->mapped) {
+        return 0;
+    }
+
+    ring = (trace_ring *) calloc(1, sizeof(trace_ring));
+    if (ring == NULL) {
+        return 0; /* decode on the calling thread instead */
+    }
+    ring->records = (trace_record *) malloc(sizeof(trace_record) * TRACE_RING_BATCHES * TRACE_RING_BATCH);
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->changed, NULL);
+    reader->ring = ring;
+    if (ring->records == NULL || pthread_create(&ring->thread, NULL, trace_ring_main, reader) != 0) {
+        pthread_mutex_destroy(&ring->lock);
+        pthread_cond_destroy(&ring->changed);
+        free(ring->records);
+        free(ring);
+        reader->ring = NULL;
+    }
+    return 0;
+} /* end open_trace */
+
+/* fast-forward over up to n records without simulating them. fixed-width
+ * binary traces jump; everything else goes through the decoder, so -k stops
+ * at the same malformed record a plain run would. returns how many records
+ * were skipped
+ */
+long long skip_records(trace_reader *reader, long long n)
+{
+    trace_record record;
+    long long skipped = 0;
+
+    if (reader->mapped && reader->ring == NULL && reader->binary && !reader->delta) {
+        long long left = (reader->len - reader->pos) / TRACE_RECORD_SIZE;
+        skipped = (n < left) ? n : left;
+        reader->pos += skipped * TRACE_RECORD_SIZE;
+        return skipped;
+    }
+
+    while (skipped < n && next_record(reader, &record)) {
+        skipped++;
+    }
+    return skipped;
+} /* end skip_records */
+
+/* write the binary header for a trace with the given TRACE_FLAG_* flags */
+void write_trace_header(FILE *out, unsigned int flags)
+{
+    unsigned char header[TRACE_HEADER_SIZE];
+    int i;
+
+    memcpy(header, TRACE_MAGIC, TRACE_MAGIC_LEN);
+    for (i = 0; i < 4; i++) {
+        header[8 + i] = (TRACE_VERSION >> (8 * i)) & 0xff;
+        header[12 + i] = (flags >> (8 * i)) & 0xff;
+    }
+    fwrite(header, 1, TRACE_HEADER_SIZE, out);
+} /* end write_trace_header */
+
+/* append one record in binary form, prev_address tracks the delta base */
+void write_trace_record(FILE *out, const trace_record *record, int delta, mem_addr_t *prev_address)
+{
+    unsigned char bytes[2 + 10]; /* op, size, up to 10 varint bytes */
+    int len = 2;
+    int i;
+
+    bytes[0] = (unsigned char) record->op;
+    bytes[1] = (unsigned char) record->size;
+
+    if (delta) {
+        long long diff = (long long) (record->address - *prev_address);
+        unsigned long long zigzag = ((unsigned long long) diff << 1) ^ (unsigned long long) (diff >> 63);
+        *prev_address = record->address;
+
+        while (zigzag >= 0x80) {
+            bytes[len++] = (unsigned char) (zigzag | 0x80);
+            zigzag >>= 7;
+        }
+        bytes[len++] = (unsigned char) zigzag;
+    } else {
+        for (i = 0; i < 8; i++) {
+            bytes[len++] = (record->address >> (8 * i)) & 0xff;
+        }
+    }
+
+    fwrite(bytes, 1, len, out);
+} /* end write_trace_record */
+
+/* convert every record of reader into a binary trace at out_file ("-" means stdout).
+ * returns the number of records written, or -1 if out_file can't be written or a
+ * record's size doesn't fit in the size byte
+ */
+long long convert_trace(trace_reader *reader, const char *out_file, int delta)
+{
+    FILE *out;
+    trace_record record;
+    mem_addr_t prev_address = 0;
+    long long num_records = 0;
+
+    out = (strcmp(out_file, "-") == 0) ? stdout : fopen(out_file, "wb");
+    if (out == NULL) {
+        return -1;
+    }
+
+    write_trace_header(out, delta ? TRACE_FLAG_DELTA : 0);
+
+    while (next_record(reader, &record)) {
+        if (record.size < 0 || record.size > 0xff) {
+            num_records = -1;
+            break;
+        }
+        write_trace_record(out, &record, delta, &prev_address);
+        num_records++;
+    }
+
+    if (ferror(out)) {
+        num_records = -1;
+    }
+    if (out != stdout) {
+        fclose(out);
+    } else {
+        fflush(out);
+    }
+    return num_records;
+} /* end convert_trace */
+
+/* checkpoint format (written by -o, loaded by -r). the header is little-endian:
+ *  0: 8 byte magic, 32-bit version, 32-bit byte order mark (written natively)
+ *  16: 32-bit s, E, b and WRITE_* flags
+ *  32: policy name, 16 bytes NUL padded
+ *  48: 64-bit clock, records replayed into the state, then hits, misses,
+ *      evictions, dirty evictions, bytes written and extra lookups
+ *  112: 32-bit meta_bytes
+ * the arena follows as build_cache lays it out (tags, meta, valid bytes), in
+ * host byte order at a page aligned offset, so -r maps the file and points
+ * the cache straight into it; pages are only read in when a set is touched
+ */
+#define CHECKPOINT_MAGIC "\223CSIMCKP"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ORDER 0x01020304
+#define CHECKPOINT_NAME_LEN 16
+#define CHECKPOINT_ARENA_OFFSET 4096
+
+/* what a checkpoint recorded besides the cache itself */
+typedef struct {
+    long long records;   /* records replayed into the state, warm-up included */
+    cache_param_t par;   /* geometry and the counters at the time it was written */
+    int write_mode;      /* WRITE_* flags */
+    const replacement_policy *policy;
+} checkpoint_info;
+
+/* encode value as a little-endian integer of num_bytes bytes */
+static inline void store_le(unsigned char *bytes, unsigned long long value, int num_bytes)
+{
+    int i;
+    for (i = 0; i < num_bytes; i++) {
+        bytes[i] = (value >> (8 * i)) & 0xff;
+    }
+}
+
+/* bytes of the arena build_cache allocates for this geometry */
+size_t arena_size(const cache_param_t *par, int meta_bytes)
+{
+    size_t total_lines = (size_t) bit_pow(par->s) * par->E;
+    return total_lines * (sizeof(mem_addr_t) + 1) + (size_t) bit_pow(par->s) * meta_bytes;
+}
+
+/* write this_cache and the counters in info to path. returns -1 if it can't be written */
+int write_checkpoint(const char *path, const cache *this_cache, const checkpoint_info *info)
+{
+    unsigned char header[CHECKPOINT_ARENA_OFFSET];
+    unsigned int order = CHECKPOINT_ORDER;
+    size_t len = arena_size(&info->par, this_cache->meta_bytes);
+    FILE *out;
+    int failed;
+
+    bzero(header, sizeof(header));
+    memcpy(header, CHECKPOINT_MAGIC, 8);
+    store_le(header + 8, CHECKPOINT_VERSION, 4);
+    memcpy(header + 12, &order, 4);
+    store_le(header + 16, info->par.s, 4);
+    store_le(header + 20, info->par.E, 4);
+    store_le(header + 24, info->par.b, 4);
+    store_le(header + 28, info->write_mode, 4);
+    strncpy((char *) header + 32, this_cache->policy->name, CHECKPOINT_NAME_LEN - 1);
+    store_le(header + 48, this_cache->clock, 8);
+    store_le(header + 56, info->records, 8);
+    store_le(header + 64, info->par.hits, 8);
+    store_le(header + 72, info->par.misses, 8);
+    store_le(header + 80, info->par.evictions, 8);
+    store_le(header + 88, info->par.dirty_evictions, 8);
+    store_le(header + 96, info->par.bytes_written, 8);
+    store_le(header + 104, info->par.extra_lookups, 8);
+    store_le(header + 112, this_cache->meta_bytes, 4);
+
+    if ((out = fopen(path, "wb")) == NULL) {
+        return -1;
+    }
+    /* the arena is one allocation starting at tags */
+    failed = fwrite(header, 1, sizeof(header), out) != sizeof(header) ||
+             fwrite(this_cache->tags, 1, len, out) != len;
+    if (fclose(out) != 0) {
+        failed = 1;
+    }
+    return failed ? -1 : 0;
+} /* end write_checkpoint */
+
+/* map the checkpoint at path into this_cache and fill info from its header.
+ * returns -1 with a message on stderr if it can't be opened or doesn't fit this build
+ */
+int load_checkpoint(const char *path, cache *this_cache, checkpoint_info *info)
+{
+    unsigned char header[CHECKPOINT_ARENA_OFFSET];
+    char name[CHECKPOINT_NAME_LEN];
+    unsigned int order;
+    struct stat st;
+    char *map;
+    size_t len;
+    int fd;
+
+    if ((fd = open(path, O_RDONLY)) < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < CHECKPOINT_ARENA_OFFSET ||
+        read(fd, header, sizeof(header)) != sizeof(header) || memcmp(header, CHECKPOINT_MAGIC, 8) != 0) {
+        close(fd);
+        return -1;
+    }
+    memcpy(&order, header + 12, 4);
+    if (load_le(header + 8, 4) != CHECKPOINT_VERSION || order != CHECKPOINT_ORDER) {
+        fprintf(stderr, "%s: checkpoint version or byte order doesn't match this build\n", path);
+        close(fd);
+        return -1;
+    }
+
+    bzero(info, sizeof(*info));
+    info->par.s = load_le(header + 16, 4);
+    info->par.E = load_le(header + 20, 4);
+    info->par.b = load_le(header + 24, 4);
+    info->write_mode = load_le(header + 28, 4);
+    info->records = load_le(header + 56, 8);
+    info->par.hits = load_le(header + 64, 8);
+    info->par.misses = load_le(header + 72, 8);
+    info->par.evictions = load_le(header + 80, 8);
+    info->par.dirty_evictions = load_le(header + 88, 8);
+    info->par.bytes_written = load_le(header + 96, 8);
+    info->par.extra_lookups = load_le(header + 104, 8);
+    memcpy(name, header + 32, CHECKPOINT_NAME_LEN);
+    name[CHECKPOINT_NAME_LEN - 1] = '\0';
+
+    /* the geometry has to be one main would accept, and the metadata its policy's size */
+    if ((info->policy = find_policy(name)) == NULL || info->par.s < 0 || info->par.s > 40 ||
+        info->par.E < 1 || info->par.b < 0 || info->par.b > 63 || !policy_supports(info->policy, info->par.E) ||
+        (int) load_le(header + 112, 4) != info->policy->meta_bytes(info->par.E)) {
+        fprintf(stderr, "%s: checkpoint has an invalid cache configuration\n", path);
+        close(fd);
+        return -1;
+    }
+    len = CHECKPOINT_ARENA_OFFSET + arena_size(&info->par, info->policy->meta_bytes(info->par.E));
+    if ((size_t) st.st_size != len) {
+        fprintf(stderr, "%s: checkpoint is truncated\n", path);
+        close(fd);
+        return -1;
+    }
+
+    /* private mapping: the run writes to its own copy-on-write pages, never the file */
+    map = (char *) mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return -1;
+    }
+
+    *this_cache = build_cache_view(map + CHECKPOINT_ARENA_OFFSET, bit_pow(info->par.s), info->par.E, info->policy);
+    this_cache->clock = load_le(header + 48, 8);
+    this_cache->mapping = map;
+    this_cache->mapping_len = len;
+    set_write_policy(this_cache, info->write_mode);
+
+    return 0;
+} /* end load_checkpoint */
+
+/* parse a -o spec, file[:N]. a trailing :N is cut off spec and stored in
+ * save_after, otherwise save_after stays -1. returns -1 on an empty file name
+ */
+int parse_save_spec(char *spec, long long *save_after)
+{
+    char *colon = strrchr(spec, ':');
+    char *end;
+    long long count;
+
+    *save_after = -1;
+    if (colon != NULL && colon[1] != '\0') {
+        errno = 0;
+        count = strtoll(colon + 1, &end, 10);
+        if (*end == '\0' && errno == 0 && count >= 0) {
+            *save_after = count;
+            *colon = '\0';
+        }
+    }
+    return spec[0] == '\0' ? -1 : 0;
+} /* end parse_save_spec */
+
+/* replay one trace record into a cache */
+static inline void replay_access(cache *this_cache, cache_param_t *par, const trace_record *record)
+{
+    switch(record->op) {
+        case 'L':
+            simulate_cache(this_cache, par, record->address);
+        break;
+        case 'S':
+            simulate_store(this_cache, par, record->address, record->size);
+        break;
+        case 'M':
+            simulate_cache(this_cache, par, record->address);
+            simulate_store(this_cache, par, record->address, record->size);
+        break;
+        default: /* instruction loads are ignored */
+        break;
+    }
+} /* end replay_access */
+
+/* cache lookups one record makes in each block it touches */
+static inline int record_lookups(char op)
+{
+    return (op == 'M') ? 2 : (op == 'L' || op == 'S');
+} /* end record_lookups */
+
+/* cut record at the first block boundary it crosses: record keeps the bytes
+ * in its first block and rest gets the remainder. returns 0 when the access
+ * fits in one block. a size of 0 is treated as one byte
+ */
+static inline int split_record(trace_record *record, trace_record *rest, int b)
+{
+    mem_addr_t end = record->address + (record->size > 0 ? record->size : 1);
+    mem_addr_t next_block = ((record->address >> b) + 1) << b;
+
+    if (end <= next_block || next_block == 0) {
+        return 0;
+    }
+    *rest = *record;
+    rest->address = next_block;
+    rest->size = (int) (end - next_block);
+    record->size = (int) (next_block - record->address);
+    return 1;
+} /* end split_record */
+
+/* replay one record, block by block under -z */
+void replay_record(cache *this_cache, cache_param_t *par, const trace_record *record)
+{
+    trace_record piece;
+    trace_record rest;
+
+    if (!par->split_blocks) {
+        replay_access(this_cache, par, record);
+        return;
+    }
+
+    piece = *record;
+    while (split_record(&piece, &rest, par->b)) {
+        replay_access(this_cache, par, &piece);
+        par->extra_lookups += record_lookups(piece.op);
+        piece = rest;
+    }
+    replay_access(this_cache, par, &piece);
+} /* end replay_record */
+
+/* parse one field of a -S spec: "4", "1-8" or "1,2,4".
+ * returns the number of values stored, or -1 if the field is malformed
+ */
+int parse_sweep_field(const char *field, int *values, int max_values)
+{
+    int num_values = 0;
+    char *end;
+
+    for (;;) {
+        long lo = strtol(field, &end, 10);
+        long hi = lo;
+        long v;
+
+        if (end == field || lo < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            field = end + 1;
+            hi = strtol(field, &end, 10);
+            if (end == field || hi < lo) {
+                return -1;
+            }
+        }
+        for (v = lo; v <= hi; v++) {
+            if (num_values == max_values) {
+                return -1;
+            }
+            values[num_values++] = (int) v;
+        }
+
+        if (*end == '\0' || *end == ':') {
+            return num_values;
+        }
+        if (*end != ',') {
+            return -1;
+        }
+        field = end + 1;
+    }
+} /* end parse_sweep_field */
+
+/* expand a "s:E:b" spec into every combination of its fields, appended to pars.
+ * returns the new number of configurations, or -1 if the spec is malformed
+ */
+int parse_sweep_spec(const char *spec, cache_param_t *pars, int num_pars)
+{
+    int s_values[64], E_values[MAX_SWEEP_CONFIGS], b_values[64];
+    int num_s, num_E, num_b;
+    int i, j, k;
+    const char *field = spec;
+
+    num_s = parse_sweep_field(field, s_values, 64);
+    if (num_s < 0 || (field = strchr(field, ':')) == NULL) {
+        return -1;
+    }
+    num_E = parse_sweep_field(++field, E_values, MAX_SWEEP_CONFIGS);
+    if (num_E < 0 || (field = strchr(field, ':')) == NULL) {
+        return -1;
+    }
+    num_b = parse_sweep_field(++field, b_values, 64);
+    if (num_b < 0 || strchr(field, ':') != NULL) {
+        return -1;
+    }
+
+    for (i = 0; i < num_s; i++) {
+        for (j = 0; j < num_E; j++) {
+            for (k = 0; k < num_b; k++) {
+                cache_param_t par;
+
+                /* same limits main() places on a single configuration */
+                if (s_values[i] == 0 || E_values[j] == 0 || b_values[k] == 0 ||
+                    s_values[i] + b_values[k] >= 64 || num_pars == MAX_SWEEP_CONFIGS) {
+                    return -1;
+                }
+
+                bzero(&par, sizeof(par));
+                par.s = s_values[i];
+                par.E = E_values[j];
+                par.b = b_values[k];
+                par.S = 1 << par.s;
+                par.B = 1 << par.b;
+                pars[num_pars++] = par;
+            }
+        }
+    }
+
+    return num_pars;
+} /* end parse_sweep_spec */
+
+/* replay the trace once into one cache per configuration, then print
+ * a summary line for each. write_mode is the -W flags, or -1 without -W
+ */
+void run_sweep(trace_reader *reader, cache_param_t *pars, int num_pars, const replacement_policy *policy, int write_mode)
+{
+    cache *caches = (cache *) malloc(sizeof(cache) * num_pars);
+    trace_record *batch = (trace_record *) malloc(sizeof(trace_record) * SWEEP_BATCH);
+    int num_records;
+    int i, k;
+
+    for (k = 0; k < num_pars; k++) {
+        caches[k] = build_cache(bit_pow(pars[k].s), pars[k].E, bit_pow(pars[k].b), policy);
+        set_write_policy(&caches[k], write_mode < 0 ? 0 : write_mode);
+    }
+
+    /* decode a batch once, then let every cache consume it while it is still hot */
+    do {
+        for (num_records = 0; num_records < SWEEP_BATCH; num_records++) {
+            if (!next_record(reader, &batch[num_records])) {
+                break;
+            }
+        }
+        for (k = 0; k < num_pars; k++) {
+            for (i = 0; i < num_records; i++) {
+                replay_record(&caches[k], &pars[k], &batch[i]);
+            }
+        }
+    } while (num_records == SWEEP_BATCH);
+
+    for (k = 0; k < num_pars; k++) {
+        printf("s:%d E:%d b:%d hits:%d misses:%d evictions:%d",
+               pars[k].s, pars[k].E, pars[k].b, pars[k].hits, pars[k].misses, pars[k].evictions);
+        if (write_mode >= 0) {
+            printf(" dirty_evictions:%d bytes_written:%lld", pars[k].dirty_evictions, pars[k].bytes_written);
+        }
+        if (pars[k].split_blocks) {
+            printf(" extra_lookups:%d", pars[k].extra_lookups);
+        }
+        printf("\n");
+        clear_cache(caches[k], bit_pow(pars[k].s), pars[k].E, bit_pow(pars[k].b));
+    }
+
+    free(batch);
+    free(caches);
+} /* end run_sweep */
+
+/* spread block numbers over the map's slots */
+static inline unsigned long long sd_hash(mem_addr_t block)
+{
+    return (block + 1) * 0x9e3779b97f4a7c15ULL;
+}
+
+/* slot of key in an open addressing table of key + 1 values, or of the
+ * empty slot it would go in
+ */
+static inline long long key_slot(const mem_addr_t *keys, long long capacity, mem_addr_t key)
+{
+    long long mask = capacity - 1;
+    long long slot = (long long) (sd_hash(key) >> 20) & mask;
+
+    while (keys[slot] != 0 && keys[slot] != key + 1) {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/* slot of block in map, or of the empty slot it would go in */
+static inline long long sd_map_slot(const sd_map *map, mem_addr_t block)
+{
+    return key_slot(map->keys, map->capacity, block);
+}
+
+/* double the map once it is half full */
+void sd_map_grow(sd_map *map)
+{
+    sd_map old = *map;
+    long long i;
+
+    map->capacity = old.capacity * 2;
+    map->keys = (mem_addr_t *) calloc(map->capacity, sizeof(mem_addr_t));
+    map->times = (long long *) malloc(sizeof(long long) * map->capacity);
+
+    for (i = 0; i < old.capacity; i++) {
+        if (old.keys[i] != 0) {
+            long long slot = sd_map_slot(map, old.keys[i] - 1);
+            map->keys[slot] = old.keys[i];
+            map->times[slot] = old.times[i];
+        }
+    }
+
+    free(old.keys);
+    free(old.times);
+} /* end sd_map_grow */
+
+/* add delta at timestamp t of a set's Fenwick tree */
+static inline void sd_tree_add(sd_set *set, long long t, int delta)
+{
+    for (; t <= set->capacity; t += t & -t) {
+        set->tree[t] += delta;
+    }
+}
+
+/* number of live marks at timestamps 1..t */
+static inline long long sd_tree_sum(const sd_set *set, long long t)
+{
+    long long sum = 0;
+    for (; t > 0; t -= t & -t) {
+        sum += set->tree[t];
+    }
+    return sum;
+}
+
+/* renumber a full timeline so only live marks remain, growing it if they
+ * would take up more than half of it, then rebuild the Fenwick tree
+ */
+void sd_compact(sd_set *set, sd_map *map)
+{
+    long long capacity = set->capacity ? set->capacity : SD_INITIAL_CAPACITY;
+    long long t, live = 0;
+
+    /* live marks are packed to the front in their original order */
+    for (t = 1; t <= set->now; t++) {
+        if (set->live[t]) {
+            live++;
+            set->block_at[live] = set->block_at[t];
+            map->times[sd_map_slot(map, set->block_at[t])] = live;
+        }
+    }
+
+    while (live * 2 > capacity) {
+        capacity *= 2;
+    }
+    if (capacity != set->capacity) {
+        free(set->tree);
+        free(set->live);
+        set->block_at = (mem_addr_t *) realloc(set->block_at, sizeof(mem_addr_t) * (capacity + 1));
+        set->tree = (int *) malloc(sizeof(int) * (capacity + 1));
+        set->live = (char *) malloc(capacity + 1);
+        set->capacity = capacity;
+    }
+
+    /* every timestamp up to live is marked; build the tree in linear time */
+    bzero(set->tree, sizeof(int) * (capacity + 1));
+    bzero(set->live, capacity + 1);
+    for (t = 1; t <= capacity; t++) {
+        long long parent = t + (t & -t);
+        if (t <= live) {
+            set->live[t] = 1;
+            set->tree[t] += 1;
+        }
+        if (parent <= capacity) {
+            set->tree[parent] += set->tree[t];
+        }
+    }
+    set->now = live;
+} /* end sd_compact */
+
+/* the LRU stack distance of an access to block within its set: how many
+ * other blocks of the set were used since block was last touched, or -1
+ * on its first access
+ */
+long long stack_distance(sd_set *set, sd_map *map, mem_addr_t block)
+{
+    long long slot;
+    long long distance = -1;
+    long long t;
+
+    if (set->now == set->capacity) {
+        sd_compact(set, map);
+    }
+    t = ++set->now;
+
+    slot = sd_map_slot(map, block);
+    if (map->keys[slot] != 0) {
+        long long last = map->times[slot];
+        distance = sd_tree_sum(set, t - 1) - sd_tree_sum(set, last);
+        set->live[last] = 0;
+        sd_tree_add(set, last, -1);
+    } else {
+        map->keys[slot] = block + 1;
+        map->count++;
+        set->distinct++;
+    }
+
+    map->times[slot] = t;
+    set->block_at[t] = block;
+    set->live[t] = 1;
+    sd_tree_add(set, t, 1);
+
+    if (map->count * 2 > map->capacity) {
+        sd_map_grow(map);
+    }
+    return distance;
+} /* end stack_distance */
+
+/* replay the trace once at fixed s and b, collecting a histogram of stack
+ * distances below max_E, then print the summary every E = 1..max_E would give
+ */
+void run_stack_distance(trace_reader *reader, int s, int b, int max_E, int split_blocks)
+{
+    long long num_sets = bit_pow(s);
+    sd_set *sets = (sd_set *) calloc(num_sets, sizeof(sd_set));
+    long long *histogram = (long long *) calloc(max_E, sizeof(long long));
+    long long accesses = 0;
+    long long hits = 0;
+    int extra_lookups = 0;
+    sd_map map;
+    trace_record record;
+    long long setIndex;
+    int E;
+
+    map.capacity = 1 << 16;
+    map.count = 0;
+    map.keys = (mem_addr_t *) calloc(map.capacity, sizeof(mem_addr_t));
+    map.times = (long long *) malloc(sizeof(long long) * map.capacity);
+
+    while (next_record(reader, &record)) {
+        int count = record_lookups(record.op);
+        trace_record rest;
+        int more;
+
+        if (count == 0) {
+            continue;
+        }
+
+        do {
+            mem_addr_t block;
+            sd_set *set;
+            long long distance;
+
+            more = split_blocks && split_record(&record, &rest, b);
+            block = record.address >> b;
+            set = &sets[block & (num_sets - 1)];
+
+            distance = stack_distance(set, &map, block);
+            if (distance >= 0 && distance < max_E) {
+                histogram[distance]++;
+            }
+            accesses++;
+
+            /* the store half of an M always finds its block on top of the stack */
+            if (count == 2) {
+                stack_distance(set, &map, block);
+                histogram[0]++;
+                accesses++;
+            }
+
+            if (more) {
+                extra_lookups += count;
+                record = rest;
+            }
+        } while (more);
+    }
+
+    /* an E-way LRU set hits exactly the accesses with distance < E, and only
+     * its first E distinct blocks are placed without evicting anything
+     */
+    for (E = 1; E <= max_E; E++) {
+        long long fills = 0;
+        for (setIndex = 0; setIndex < num_sets; setIndex++) {
+            fills += (sets[setIndex].distinct < E) ? sets[setIndex].distinct : E;
+        }
+        hits += histogram[E - 1];
+        printf("s:%d E:%d b:%d hits:%lld misses:%lld evictions:%lld",
+               s, E, b, hits, accesses - hits, accesses - hits - fills);
+        if (split_blocks) {
+            printf(" extra_lookups:%d", extra_lookups);
+        }
+        printf("\n");
+    }
+
+    for (setIndex = 0; setIndex < num_sets; setIndex++) {
+        free(sets[setIndex].tree);
+        free(sets[setIndex].block_at);
+        free(sets[setIndex].live);
+    }
+    free(sets);
+    free(histogram);
+    free(map.keys);
+    free(map.times);
+} /* end run_stack_distance */
+
+/* shard thread: replay accesses from its queue until the decoder is done */
+void *shard_main(void *arg)
+{
+    shard_worker *worker = (shard_worker *) arg;
+    shard_queue *queue = &worker->queue;
+    unsigned long long head = queue->head;
+
+    for (;;) {
+        if (head == queue->cached_tail) {
+            queue->cached_tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+            if (head == queue->cached_tail) {
+                /* an empty queue is only final once done is set after the last publish */
+                if (__atomic_load_n(&queue->done, __ATOMIC_ACQUIRE) &&
+                    head == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE)) {
+                    break;
+                }
+                sched_yield();
+                continue;
+            }
+        }
+
+        /* drain everything published so far before touching tail again */
+        while (head != queue->cached_tail) {
+            replay_record(&worker->shard_cache, &worker->par, &queue->items[head & (SHARD_QUEUE_SIZE - 1)]);
+            head++;
+        }
+        __atomic_store_n(&queue->head, head, __ATOMIC_RELEASE);
+    }
+
+    return NULL;
+} /* end shard_main */
+
+/* make the decoder's buffered accesses visible to the shard */
+static inline void publish_shard(shard_queue *queue)
+{
+    __atomic_store_n(&queue->tail, queue->write_pos, __ATOMIC_RELEASE);
+}
+
+/* decoder side: append one access, waiting while the ring is full */
+static inline void push_shard(shard_queue *queue, const trace_record *access)
+{
+    while (queue->write_pos - queue->cached_head == SHARD_QUEUE_SIZE) {
+        publish_shard(queue); /* the shard may be waiting on what we buffered */
+        queue->cached_head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        if (queue->write_pos - queue->cached_head == SHARD_QUEUE_SIZE) {
+            sched_yield();
+        }
+    }
+
+    queue->items[queue->write_pos & (SHARD_QUEUE_SIZE - 1)] = *access;
+    queue->write_pos++;
+    if ((queue->write_pos & (SHARD_PUBLISH_BATCH - 1)) == 0) {
+        publish_shard(queue);
+    }
+}
+
+/* replay the trace with the sets split across num_shards threads; the summed
+ * counters end up in par. returns -1 if the threads could not be started
+ */
+int run_sharded(trace_reader *reader, cache *this_cache, cache_param_t *par, int num_shards)
+{
+    shard_worker *workers;
+    trace_record record;
+    int set_bits = par->s;
+    int block_bits = par->b;
+    unsigned long long set_mask = (1ULL << set_bits) - 1;
+    int started;
+    int k;
+
+    if (posix_memalign((void **) &workers, HOST_LINE_BYTES, sizeof(shard_worker) * num_shards) != 0) {
+        return -1;
+    }
+    bzero(workers, sizeof(shard_worker) * num_shards);
+
+    for (started = 0; started < num_shards; started++) {
+        shard_worker *worker = &workers[started];
+        worker->queue.items = (trace_record *) malloc(sizeof(trace_record) * SHARD_QUEUE_SIZE);
+        worker->shard_cache = *this_cache;
+        worker->par = *par;
+        worker->par.hits = 0;
+        worker->par.misses = 0;
+        worker->par.evictions = 0;
+        worker->par.dirty_evictions = 0;
+        worker->par.bytes_written = 0;
+        worker->par.split_blocks = 0; /* the decoder already split the accesses */
+        if (worker->queue.items == NULL ||
+            pthread_create(&worker->thread, NULL, shard_main, worker) != 0) {
+            break;
+        }
+    }
+
+    /* shard k owns the contiguous sets [k * S / n, (k + 1) * S / n), which
+     * keeps threads off each other's cache lines in the arena
+     */
+    if (started == num_shards) {
+        while (next_record(reader, &record)) {
+            trace_record rest;
+            int more;
+
+            /* under -z the blocks of one access may belong to different shards */
+            do {
+                unsigned long long setIndex;
+                shard_queue *queue;
+
+                more = par->split_blocks && split_record(&record, &rest, block_bits);
+                setIndex = (record.address >> block_bits) & set_mask;
+                queue = &workers[(setIndex * num_shards) >> set_bits].queue;
+                if (more) {
+                    par->extra_lookups += record_lookups(record.op);
+                }
+
+                switch(record.op) {
+                    case 'M':
+                        /* split into its load and store halves */
+                        record.op = 'L';
+                        push_shard(queue, &record);
+                        record.op = 'S';
+                        push_shard(queue, &record);
+                    break;
+                    case 'L':
+                    case 'S':
+                        push_shard(queue, &record);
+                    break;
+                    default:
+                    break;
+                }
+                if (more) {
+                    record = rest;
+                }
+            } while (more);
+        }
+    }
+
+    for (k = 0; k < started; k++) {
+        publish_shard(&workers[k].queue);
+        __atomic_store_n(&workers[k].queue.done, 1, __ATOMIC_RELEASE);
+    }
+    for (k = 0; k < started; k++) {
+        pthread_join(workers[k].thread, NULL);
+        par->hits += workers[k].par.hits;
+        par->misses += workers[k].par.misses;
+        par->evictions += workers[k].par.evictions;
+        par->dirty_evictions += workers[k].par.dirty_evictions;
+        par->bytes_written += workers[k].par.bytes_written;
+    }
+
+    for (k = 0; k < num_shards; k++) {
+        free(workers[k].queue.items);
+    }
+    free(workers);
+    return (started == num_shards) ? 0 : -1;
+} /* end run_sharded */
+
+/* parse a -L spec "s:E:b[:policy[:inclusion]]" into level.
+ * returns 0, or -1 if the spec is malformed
+ */
+int parse_level_spec(const char *spec, cache_level *level)
+{
+    char name[32];
+    const char *field;
+    const replacement_policy *policy = find_policy("lru");
+    size_t len;
+    int used = 0;
+
+    bzero(level, sizeof(*level));
+    level->inclusion = INCLUSION_NINE;
+
+    if (sscanf(spec, "%d:%d:%d%n", &level->par.s, &level->par.E, &level->par.b, &used) != 3) {
+        return -1;
+    }
+    if (level->par.s < 1 || level->par.E < 1 || level->par.b < 1 || level->par.s + level->par.b >= 64) {
+        return -1;
+    }
+    level->par.S = 1 << level->par.s;
+    level->par.B = 1 << level->par.b;
+
+    /* optional policy, then optional inclusion mode */
+    field = spec + used;
+    if (*field == ':') {
+        field++;
+        len = strcspn(field, ":");
+        if (len == 0 || len >= sizeof(name)) {
+            return -1;
+        }
+        memcpy(name, field, len);
+        name[len] = '\0';
+        if ((policy = find_policy(name)) == NULL) {
+            return -1;
+        }
+        field += len;
+    }
+    if (*field == ':') {
+        field++;
+        if (strcmp(field, "inclusive") == 0) {
+            level->inclusion = INCLUSION_INCLUSIVE;
+        } else if (strcmp(field, "exclusive") == 0) {
+            level->inclusion = INCLUSION_EXCLUSIVE;
+        } else if (strcmp(field, "nine") != 0) {
+            return -1;
+        }
+    } else if (*field != '\0') {
+        return -1;
+    }
+
+    if (!policy_supports(policy, level->par.E)) {
+        return -1;
+    }
+    level->level_cache.policy = policy; /* built by run_hierarchy */
+    return 0;
+} /* end parse_level_spec */
+
+/* replay the trace through a chain of levels and print each level's summary */
+void run_hierarchy(trace_reader *reader, cache_level *levels, int num_levels)
+{
+    cache_param_t *l1 = &levels[0].par;
+    trace_record record;
+    int i;
+
+    for (i = 0; i < num_levels; i++) {
+        cache_param_t *par = &levels[i].par;
+        levels[i].level_cache = build_cache(bit_pow(par->s), par->E, bit_pow(par->b), levels[i].level_cache.policy);
+    }
+
+    while (next_record(reader, &record)) {
+        trace_record rest;
+        int more;
+
+        /* -z splits at L1 block boundaries, lower levels see whole L1 blocks */
+        do {
+            more = l1->split_blocks && split_record(&record, &rest, l1->b);
+            if (more) {
+                l1->extra_lookups += record_lookups(record.op);
+            }
+
+            switch(record.op) {
+                case 'M':
+                    /* the store half is a second access */
+                    simulate_hierarchy(levels, num_levels, record.address);
+                    simulate_hierarchy(levels, num_levels, record.address);
+                break;
+                case 'L':
+                case 'S':
+                    simulate_hierarchy(levels, num_levels, record.address);
+                break;
+                default:
+                break;
+            }
+            if (more) {
+                record = rest;
+            }
+        } while (more);
+    }
+
+    for (i = 0; i < num_levels; i++) {
+        cache_param_t *par = &levels[i].par;
+        printf("L%d hits:%d misses:%d evictions:%d\n", i + 1, par->hits, par->misses, par->evictions);
+        clear_cache(levels[i].level_cache, bit_pow(par->s), par->E, bit_pow(par->b));
+    }
+    if (l1->split_blocks) {
+        printf("extra_lookups:%d\n", l1->extra_lookups);
+    }
+} /* end run_hierarchy */
+
+/* add the counters of delta to stats */
+static inline void add_stats(access_stats *stats, const access_stats *delta)
+{
+    stats->hits += delta->hits;
+    stats->misses += delta->misses;
+    stats->evictions += delta->evictions;
+    stats->dirty_evictions += delta->dirty_evictions;
+    stats->compulsory += delta->compulsory;
+    stats->capacity += delta->capacity;
+    stats->conflict += delta->conflict;
+}
+
+/* the counters of pc, added to the map on its first access. the pointer
+ * only stays valid until the next call, which may grow the map
+ */
+access_stats *pc_stats(pc_map *map, mem_addr_t pc)
+{
+    long long slot = key_slot(map->keys, map->capacity, pc);
+
+    if (map->keys[slot] == 0) {
+        if (2 * (map->count + 1) > map->capacity) {
+            pc_map old = *map;
+            long long i;
+
+            map->capacity = old.capacity * 2;
+            map->keys = (mem_addr_t *) calloc(map->capacity, sizeof(mem_addr_t));
+            map->stats = (access_stats *) malloc(sizeof(access_stats) * map->capacity);
+            for (i = 0; i < old.capacity; i++) {
+                if (old.keys[i] != 0) {
+                    long long moved = key_slot(map->keys, map->capacity, old.keys[i] - 1);
+                    map->keys[moved] = old.keys[i];
+                    map->stats[moved] = old.stats[i];
+                }
+            }
+            free(old.keys);
+            free(old.stats);
+            slot = key_slot(map->keys, map->capacity, pc);
+        }
+        map->keys[slot] = pc + 1;
+        bzero(&map->stats[slot], sizeof(access_stats));
+        map->count++;
+    }
+    return &map->stats[slot];
+} /* end pc_stats */
+
+/* an empty shadow for a cache of num_lines lines in total */
+void build_shadow(shadow_cache *shadow, int num_lines)
+{
+    shadow->capacity = 1 << 16;
+    shadow->count = 0;
+    shadow->keys = (mem_addr_t *) calloc(shadow->capacity, sizeof(mem_addr_t));
+    shadow->lines = (int *) malloc(sizeof(int) * shadow->capacity);
+    shadow->line_block = (mem_addr_t *) malloc(sizeof(mem_addr_t) * num_lines);
+    shadow->prev = (int *) malloc(sizeof(int) * num_lines);
+    shadow->next = (int *) malloc(sizeof(int) * num_lines);
+    shadow->num_lines = num_lines;
+    shadow->used = 0;
+    shadow->head = -1;
+    shadow->tail = -1;
+}
+
+void clear_shadow(shadow_cache *shadow)
+{
+    free(shadow->keys);
+    free(shadow->lines);
+    free(shadow->line_block);
+    free(shadow->prev);
+    free(shadow->next);
+}
+
+/* take line out of the LRU list */
+static inline void shadow_unlink(shadow_cache *shadow, int line)
+{
+    if (shadow->prev[line] >= 0) {
+        shadow->next[shadow->prev[line]] = shadow->next[line];
+    } else {
+        shadow->head = shadow->next[line];
+    }
+    if (shadow->next[line] >= 0) {
+        shadow->prev[shadow->next[line]] = shadow->prev[line];
+    } else {
+        shadow->tail = shadow->prev[line];
+    }
+}
+
+/* make line the most recently used */
+static inline void shadow_push(shadow_cache *shadow, int line)
+{
+    shadow->prev[line] = -1;
+    shadow->next[line] = shadow->head;
+    if (shadow->head >= 0) {
+        shadow->prev[shadow->head] = line;
+    } else {
+        shadow->tail = line;
+    }
+    shadow->head = line;
+}
+
+/* double the block map once it is half full */
+void shadow_grow(shadow_cache *shadow)
+{
+    mem_addr_t *old_keys = shadow->keys;
+    int *old_lines = shadow->lines;
+    long long old_capacity = shadow->capacity;
+    long long i;
+
+    shadow->capacity = old_capacity * 2;
+    shadow->keys = (mem_addr_t *) calloc(shadow->capacity, sizeof(mem_addr_t));
+    shadow->lines = (int *) malloc(sizeof(int) * shadow->capacity);
+    for (i = 0; i < old_capacity; i++) {
+        if (old_keys[i] != 0) {
+            long long slot = key_slot(shadow->keys, shadow->capacity, old_keys[i] - 1);
+            shadow->keys[slot] = old_keys[i];
+            shadow->lines[slot] = old_lines[i];
+        }
+    }
+    free(old_keys);
+    free(old_lines);
+} /* end shadow_grow */
+
+/* access block in the shadow cache. returns SHADOW_HIT, or the class of
+ * miss the configured cache would have if it misses: SHADOW_COMPULSORY for
+ * a block never seen before, SHADOW_CAPACITY for one the shadow evicted
+ */
+int shadow_access(shadow_cache *shadow, mem_addr_t block)
+{
+    long long slot = key_slot(shadow->keys, shadow->capacity, block);
+    int result;
+    int line;
+
+    if (shadow->keys[slot] != 0 && (line = shadow->lines[slot]) >= 0) {
+        if (line != shadow->head) {
+            shadow_unlink(shadow, line);
+            shadow_push(shadow, line);
+        }
+        return SHADOW_HIT;
+    }
+
+    if (shadow->keys[slot] == 0) {
+        result = SHADOW_COMPULSORY;
+        if (2 * (shadow->count + 1) > shadow->capacity) {
+            shadow_grow(shadow);
+            slot = key_slot(shadow->keys, shadow->capacity, block);
+        }
+        shadow->keys[slot] = block + 1;
+        shadow->count++;
+    } else {
+        result = SHADOW_CAPACITY;
+    }
+
+    /* fill a free line, or evict the LRU one and forget where its block went */
+    if (shadow->used < shadow->num_lines) {
+        line = shadow->used++;
+    } else {
+        line = shadow->tail;
+        shadow_unlink(shadow, line);
+        shadow->lines[key_slot(shadow->keys, shadow->capacity, shadow->line_block[line])] = -1;
+    }
+    shadow->line_block[line] = block;
+    shadow->lines[slot] = line;
+    shadow_push(shadow, line);
+    return result;
+} /* end shadow_access */
+
+/* replay one L or S, then charge what it did to its set and pc */
+static inline void instrumented_lookup(cache *this_cache, cache_param_t *par, const trace_record *access,
+                                       access_stats *set, access_stats *pc, shadow_cache *shadow)
+{
+    cache_param_t before = *par;
+    access_stats delta;
+
+    replay_access(this_cache, par, access);
+
+    delta.hits = par->hits - before.hits;
+    delta.misses = par->misses - before.misses;
+    delta.evictions = par->evictions - before.evictions;
+    delta.dirty_evictions = par->dirty_evictions - before.dirty_evictions;
+    delta.compulsory = 0;
+    delta.capacity = 0;
+    delta.conflict = 0;
+    if (shadow != NULL) {
+        int shadow_result = shadow_access(shadow, access->address >> par->b);
+        if (delta.misses) {
+            delta.compulsory = (shadow_result == SHADOW_COMPULSORY);
+            delta.capacity = (shadow_result == SHADOW_CAPACITY);
+            delta.conflict = (shadow_result == SHADOW_HIT);
+        }
+    }
+
+    add_stats(set, &delta);
+    if (pc != NULL) {
+        add_stats(pc, &delta);
+    }
+} /* end instrumented_lookup */
+
+/* replay the trace like the plain loop in main does, but charge every
+ * lookup to its set and, when pcs is given, to the instruction issuing it.
+ * with a shadow cache every miss is also classified
+ */
+void run_instrumented(trace_reader *reader, cache *this_cache, cache_param_t *par, access_stats *sets, pc_map *pcs,
+                      shadow_cache *shadow)
+{
+    unsigned long long set_mask = (1ULL << par->s) - 1;
+    access_stats *pc = (pcs != NULL) ? pc_stats(pcs, 0) : NULL;
+    trace_record record;
+    trace_record rest;
+    int more;
+
+    while (next_record(reader, &record)) {
+        if (record.op == 'I') {
+            if (pcs != NULL) {
+                pc = pc_stats(pcs, record.address);
+            }
+            continue;
+        }
+        if (record_lookups(record.op) == 0) {
+            continue;
+        }
+
+        do {
+            access_stats *set;
+
+            more = par->split_blocks && split_record(&record, &rest, par->b);
+            if (more) {
+                par->extra_lookups += record_lookups(record.op);
+            }
+            set = &sets[(record.address >> par->b) & set_mask];
+
+            /* the shadow has to see the load and store halves of an M apart */
+            if (record.op == 'M') {
+                record.op = 'L';
+                instrumented_lookup(this_cache, par, &record, set, pc, shadow);
+                record.op = 'S';
+            }
+            instrumented_lookup(this_cache, par, &record, set, pc, shadow);
+            if (more) {
+                record = rest;
+            }
+        } while (more);
+    }
+} /* end run_instrumented */
+
+/* -H and -P write JSON when the file name ends in .json, CSV otherwise */
+static int stats_format_json(const char *path)
+{
+    size_t len = strlen(path);
+    return len >= 5 && strcmp(path + len - 5, ".json") == 0;
+}
+
+/* one row of -H/-P output: a CSV line, or a JSON object in the array.
+ * classify adds the -C miss classes
+ */
+void write_stats_row(FILE *out, int json, int classify, const char *key_name, const char *key,
+                     const access_stats *stats, int first)
+{
+    if (json) {
+        fprintf(out, "%s{\"%s\":%s,\"hits\":%d,\"misses\":%d,\"evictions\":%d,\"dirty_evictions\":%d",
+                first ? "\n  " : ",\n  ", key_name, key,
+                stats->hits, stats->misses, stats->evictions, stats->dirty_evictions);
+        if (classify) {
+            fprintf(out, ",\"compulsory\":%d,\"capacity\":%d,\"conflict\":%d",
+                    stats->compulsory, stats->capacity, stats->conflict);
+        }
+        fprintf(out, "}");
+    } else {
+        fprintf(out, "%s,%d,%d,%d,%d", key,
+                stats->hits, stats->misses, stats->evictions, stats->dirty_evictions);
+        if (classify) {
+            fprintf(out, ",%d,%d,%d", stats->compulsory, stats->capacity, stats->conflict);
+        }
+        fprintf(out, "\n");
+    }
+} /* end write_stats_row */
+
+/* the header of a -H/-P file before its rows, the footer after them */
+void write_stats_frame(FILE *out, int json, int classify, const char *key_name, int header)
+{
+    if (json) {
+        fprintf(out, header ? "[" : "\n]\n");
+    } else if (header) {
+        fprintf(out, "%s,hits,misses,evictions,dirty_evictions%s\n", key_name,
+                classify ? ",compulsory,capacity,conflict" : "");
+    }
+} /* end write_stats_frame */
+
+/* -H: every set, in index order. returns -1 if path can't be written */
+int write_set_stats(const char *path, const access_stats *sets, long long num_sets, int classify)
+{
+    FILE *out = fopen(path, "w");
+    int json = stats_format_json(path);
+    char key[24];
+    long long i;
+
+    if (out == NULL) {
+        return -1;
+    }
+    write_stats_frame(out, json, classify, "set", 1);
+    for (i = 0; i < num_sets; i++) {
+        sprintf(key, "%lld", i);
+        write_stats_row(out, json, classify, "set", key, &sets[i], i == 0);
+    }
+    write_stats_frame(out, json, classify, "set", 0);
+    return fclose(out) == 0 ? 0 : -1;
+} /* end write_set_stats */
+
+/* parse a -F spec "kind[:degree[:latency]]" into pf.
+ * returns 0, or -1 if the spec is malformed
+ */
+int parse_prefetch_spec(const char *spec, prefetcher *pf)
+{
+    static const char *kinds[] = { "next", "stride", "stream" };
+    size_t len = strcspn(spec, ":");
+    const char *field = spec + len;
+    int used = 0;
+    int k;
+
+    bzero(pf, sizeof(*pf));
+    pf->kind = -1;
+    pf->degree = 1;
+    for (k = 0; k < 3; k++) {
+        if (strlen(kinds[k]) == len && strncmp(spec, kinds[k], len) == 0) {
+            pf->kind = k;
+        }
+    }
+    if (pf->kind < 0) {
+        return -1;
+    }
+
+    if (*field == ':') {
+        if (sscanf(field, ":%d%n", &pf->degree, &used) != 1) {
+            return -1;
+        }
+        field += used;
+    }
+    if (*field == ':') {
+        if (sscanf(field, ":%d%n", &pf->latency, &used) != 1) {
+            return -1;
+        }
+        field += used;
+    }
+    if (*field != '\0' || pf->degree < 1 || pf->degree > PREFETCH_MAX_DEGREE || pf->latency < 0) {
+        return -1;
+    }
+    return 0;
+} /* end parse_prefetch_spec */
+
+/* slot of block in the in-flight ring, or -1 */
+static int prefetch_in_flight(const prefetcher *pf, mem_addr_t block)
+{
+    int i;
+
+    for (i = 0; i < pf->queue_count; i++) {
+        int slot = (pf->queue_head + i) % PREFETCH_QUEUE;
+        if (pf->queue_live[slot] && pf->queue_block[slot] == block) {
+            return slot;
+        }
+    }
+    return -1;
+}
+
+/* fill a prefetched block, unless a demand access brought it in first */
+void prefetch_fill(cache *this_cache, cache_param_t *par, prefetcher *pf, mem_addr_t block)
+{
+    set_ref set;
+    int empty_index;
+    int way;
 
-    cache newCache; 
-    cache_set set;
-    set_line line;
+    locate_set(this_cache, par, block << par->b, &set);
+    if (find_way(&set, par->E, &empty_index) >= 0) {
+        return;
+    }
+    if (fill_way(this_cache, par, &set, empty_index, &way) == CACHE_MISS_EVICT &&
+        (this_cache->evicted_flags & LINE_PREFETCHED)) {
+        pf->polluting++;
+    }
+    set.valid[way] |= LINE_PREFETCHED;
+} /* end prefetch_fill */
 
-    int setIndex;
-    int lineIndex;
+/* ask for block, dropping it if it is cached, in flight or the ring is full */
+void prefetch_issue(cache *this_cache, cache_param_t *par, prefetcher *pf, mem_addr_t block)
+{
+    set_ref set;
+    int empty_index;
+    int slot;
 
-    /* from lab instructions, use malloc function to allocate storage */
-    newCache.sets = (cache_set *) malloc(sizeof(cache_set) * num_sets);
+    locate_set(this_cache, par, block << par->b, &set);
+    if (find_way(&set, par->E, &empty_index) >= 0 || prefetch_in_flight(pf, block) >= 0) {
+        return;
+    }
+    pf->issued++;
+    if (pf->latency == 0) {
+        prefetch_fill(this_cache, par, pf, block);
+        return;
+    }
+    if (pf->queue_count == PREFETCH_QUEUE) {
+        pf->issued--;
+        return;
+    }
+    slot = (pf->queue_head + pf->queue_count) % PREFETCH_QUEUE;
+    pf->queue_block[slot] = block;
+    pf->queue_due[slot] = pf->now + pf->latency;
+    pf->queue_live[slot] = 1;
+    pf->queue_count++;
+} /* end prefetch_issue */
 
-    /* cache is an array of s sets with index 0 to s-1 */
-    for (setIndex = 0; setIndex < num_sets; setIndex++) 
-    {
-        /* build E lines for each set */
-        set.lines =  (set_line *) malloc(sizeof(set_line) * num_lines);
-        newCache.sets[setIndex] = set;
+/* train the prefetcher on a demand access and issue what it predicts.
+ * trigger is set for a miss or the first use of a prefetched line
+ */
+void prefetch_train(cache *this_cache, cache_param_t *par, prefetcher *pf, mem_addr_t pc, mem_addr_t address, int trigger)
+{
+    mem_addr_t block = address >> par->b;
+    int k;
 
-        /* build b block offset bits for each line */
-        for (lineIndex = 0; lineIndex < num_lines; lineIndex ++) 
-        {
-            line.access_count = 0;
-            line.valid = 0;
-            line.tag = 0; 
-            set.lines[lineIndex] = line;    
+    if (pf->kind == PREFETCH_NEXT) {
+        if (trigger) {
+            for (k = 1; k <= pf->degree; k++) {
+                prefetch_issue(this_cache, par, pf, block + k);
+            }
         }
-    } 
+    } else if (pf->kind == PREFETCH_STRIDE) {
+        stride_entry *entry = &pf->strides[(sd_hash(pc) >> 20) & (STRIDE_TABLE - 1)];
+        long long stride = (long long) (address - entry->last);
 
-    return newCache;
-} /* end build_cache */
+        if (entry->pc != pc) {
+            entry->pc = pc;
+            entry->stride = 0;
+            entry->confidence = 0;
+        } else if (stride == entry->stride && stride != 0) {
+            entry->confidence += (entry->confidence < 3);
+        } else if (entry->confidence > 0) {
+            entry->confidence--;
+        } else {
+            entry->stride = stride;
+        }
+        entry->last = address;
 
-/* call free function to clean up cache after main simulation is run */
-void clear_cache(cache this_cache, long long num_sets, int num_lines, long long block_size) 
-{
-    int setIndex;
+        if (entry->confidence >= 2) {
+            for (k = 1; k <= pf->degree; k++) {
+                mem_addr_t target = (address + entry->stride * k) >> par->b;
+                if (target != block) {
+                    prefetch_issue(this_cache, par, pf, target);
+                }
+            }
+        }
+    } else if (trigger) {
+        /* a trigger within degree blocks of a detector advances it, otherwise
+         * the least recently used detector starts over at this block
+         */
+        stream_entry *stream = NULL;
+        stream_entry *oldest = &pf->streams[0];
+        long long distance = 0;
 
-    for (setIndex = 0; setIndex < num_sets; setIndex ++) {
-        cache_set set = this_cache.sets[setIndex];
-        if (set.lines != NULL) {    
-            free(set.lines);
+        for (k = 0; k < STREAM_COUNT; k++) {
+            stream_entry *candidate = &pf->streams[k];
+            long long d = (long long) (block - candidate->last);
+            if (candidate->stamp != 0 && d != 0 && d >= -pf->degree && d <= pf->degree &&
+                (candidate->direction == 0 || (d > 0) == (candidate->direction > 0))) {
+                stream = candidate;
+                distance = d;
+                break;
+            }
+            if (candidate->stamp < oldest->stamp) {
+                oldest = candidate;
+            }
         }
-    } 
 
-    if (this_cache.sets != NULL) {
-        free(this_cache.sets);
+        if (stream == NULL) {
+            oldest->last = block;
+            oldest->direction = 0;
+            oldest->stamp = pf->now + 1;
+            return;
+        }
+        stream->direction = (distance > 0) ? 1 : -1;
+        stream->last = block;
+        stream->stamp = pf->now + 1;
+        for (k = 1; k <= pf->degree; k++) {
+            prefetch_issue(this_cache, par, pf, block + (long long) stream->direction * k);
+        }
     }
-} /* end clear_cache */
-
-/* find an empty line in a set by checking if the valid tag is set to 0 or 1 
- * if the valid tag is 0, then the line is empty
- */
-int get_empty_line(cache_set set, cache_param_t par) {
+} /* end prefetch_train */
 
-    set_line line;
-    int num_lines = par.E;
-    int i;
+/* one demand L or S with the prefetcher watching */
+static inline void prefetched_lookup(cache *this_cache, cache_param_t *par, prefetcher *pf,
+                                     const trace_record *access, mem_addr_t pc)
+{
+    mem_addr_t block = access->address >> par->b;
+    int trigger = 0;
+    int result;
 
-    for (i = 0; i < num_lines; i ++) {
-        line = set.lines[i];
-        if (line.valid == 0) {
-            return i;
+    /* everything due by now has arrived */
+    while (pf->queue_count > 0 && pf->queue_due[pf->queue_head] <= pf->now) {
+        if (pf->queue_live[pf->queue_head]) {
+            prefetch_fill(this_cache, par, pf, pf->queue_block[pf->queue_head]);
         }
+        pf->queue_head = (pf->queue_head + 1) % PREFETCH_QUEUE;
+        pf->queue_count--;
     }
-    
-    return 0;
-} /* end get_empty_line */
 
-/* get_LRU finds and returns the index of LRU line */ 
-int get_LRU (cache_set this_set, cache_param_t par, int *used_lines) {
+    result = (access->op == 'L') ? simulate_cache(this_cache, par, access->address)
+                                 : simulate_store(this_cache, par, access->address, access->size);
 
-    int num_lines = par.E;
-    
-    /* initialize both the most and least frequently used lines 
-     * equal to the given set's last used line
-     */
-    int max_used = this_set.lines[0].access_count; 
-    int min_used = this_set.lines[0].access_count;
-    
-    /* initialize and keep track of the LRU to return */
-    int min_used_index = 0;
-    
-    int lineIndex;
-    set_line line; 
-
-    for (lineIndex = 1; lineIndex < num_lines; lineIndex ++) {
-    
-        /* we start searching through all the lines in the set */
-        line = this_set.lines[lineIndex];
-
-        /* if the current min used line is greater than the number of times this line has been accessed,
-         * store the index of this line to be returned later 
-         * and update value of min used line *
-         */
-        if (min_used > line.access_count) {
-            min_used_index = lineIndex; 
-            min_used = line.access_count;
-        }
+    if (result == CACHE_HIT) {
+        set_ref set;
+        int empty_index;
+        int way;
 
-        /* otherwise, if the current max used line is less than the current line,
-         * update the value of the max used line 
-         */
-        if (max_used < line.access_count) {
-            max_used = line.access_count;
+        locate_set(this_cache, par, access->address, &set);
+        way = find_way(&set, par->E, &empty_index);
+        if (set.valid[way] & LINE_PREFETCHED) {
+            set.valid[way] &= ~LINE_PREFETCHED;
+            pf->useful++;
+            trigger = 1;
+        }
+    } else {
+        int slot = prefetch_in_flight(pf, block);
+        if (slot >= 0) {
+            pf->queue_live[slot] = 0;
+            pf->late++;
+        }
+        if (result == CACHE_MISS_EVICT && (this_cache->evicted_flags & LINE_PREFETCHED)) {
+            pf->polluting++;
         }
+        trigger = 1;
     }
 
-    /* used_lines[0] is LRU 
-     * used_lines[1] is current LRU counter or most recently used 
-     */
-    used_lines[0] = min_used;
-    used_lines[1] = max_used;
-    
-    /* return the index of the LRU line from the inputted set */ 
-    return min_used_index;
-    
-} /* end get_LRU */
+    prefetch_train(this_cache, par, pf, pc, access->address, trigger);
+    pf->now++;
+} /* end prefetched_lookup */
+
+/* replay the trace with the prefetcher in the loop; data accesses take
+ * the address of the I record before them as their PC
+ */
+void run_prefetch(trace_reader *reader, cache *this_cache, cache_param_t *par, prefetcher *pf)
+{
+    mem_addr_t pc = 0;
+    trace_record record;
+    trace_record rest;
+    int more;
 
-/* runs the trace simulation */
-cache_param_t simulate_cache (cache this_cache, cache_param_t par, mem_addr_t address) {
+    while (next_record(reader, &record)) {
+        if (record.op == 'I') {
+            pc = record.address;
+            continue;
+        }
+        if (record_lookups(record.op) == 0) {
+            continue;
+        }
+
+        do {
+            more = par->split_blocks && split_record(&record, &rest, par->b);
+            if (more) {
+                par->extra_lookups += record_lookups(record.op);
+            }
+            if (record.op == 'M') {
+                record.op = 'L';
+                prefetched_lookup(this_cache, par, pf, &record, pc);
+                record.op = 'S';
+            }
+            prefetched_lookup(this_cache, par, pf, &record, pc);
+            if (more) {
+                record = rest;
+            }
+        } while (more);
+    }
+} /* end run_prefetch */
 
-        int lineIndex;
-        int cache_full = 1;  /* flag if cache does not have empty lines */
+/* parse a -m spec "unit:period[:warm]" into spec; warm defaults to unit,
+ * or what is left of the period. returns 0, or -1 if the spec is malformed
+ */
+int parse_sample_spec(const char *spec, sample_spec *sample)
+{
+    int used = 0;
 
-        int num_lines = par.E;
-        int prev_hits = par.hits;
+    if (sscanf(spec, "%lld:%lld%n", &sample->unit, &sample->period, &used) != 2) {
+        return -1;
+    }
+    sample->warm = -1;
+    if (spec[used] == ':') {
+        int more = 0;
+        if (sscanf(spec + used, ":%lld%n", &sample->warm, &more) != 1 || sample->warm < 0) {
+            return -1;
+        }
+        used += more;
+    }
+    if (spec[used] != '\0') {
+        return -1;
+    }
+    if (sample->warm < 0) {
+        sample->warm = sample->unit;
+        if (sample->unit + sample->warm > sample->period) {
+            sample->warm = sample->period - sample->unit;
+        }
+    }
+    if (sample->unit < 1 || sample->warm < 0 || sample->unit + sample->warm > sample->period) {
+        return -1;
+    }
+    return 0;
+} /* end parse_sample_spec */
 
-        int tag_size = (64 - (par.s + par.b));
+/* 95% confidence half-width of total = records * mean rate, from the sum
+ * and sum of squares of the per-sample rates
+ */
+static long long sample_ci(double sum, double sum_sq, int samples, long long records)
+{
+    double mean;
+    double variance;
 
-        unsigned long long temp = address << (tag_size);
-        unsigned long long setIndex = temp >> (tag_size + par.b);
+    if (samples < 2) {
+        return -1;
+    }
+    mean = sum / samples;
+    variance = (sum_sq - samples * mean * mean) / (samples - 1);
+    if (variance < 0) {
+        variance = 0; /* rounding on identical samples */
+    }
+    return (long long) (1.96 * sqrt(variance / samples) * records + 0.5);
+}
 
-        mem_addr_t input_tag = address >> (par.s + par.b);
+/* scale one counted sum up to the records the samples stand for */
+static inline long long scale_count(long long counted, long long records, long long measured)
+{
+    return (long long) ((double) counted * records / measured + 0.5);
+}
 
-        cache_set query_set = this_cache.sets[setIndex];
+/* printSummary() takes ints; past INT_MAX only the sample line is exact */
+static inline int clamp_count(long long n)
+{
+    return (n > INT_MAX) ? INT_MAX : (int) n;
+}
 
-        for (lineIndex = 0; lineIndex < num_lines; lineIndex ++) {
+/* replay the rest of the trace in samples and leave the estimated totals in
+ * result->estimate. par's counters end up holding the counted sums (what the
+ * samples themselves hit and missed). replayed is how many records -w already
+ * warmed the cache with
+ */
+void run_sampled(trace_reader *reader, cache *this_cache, cache_param_t *par, const sample_spec *spec,
+                 long long replayed, sample_result *result)
+{
+    long long gap = spec->period - spec->unit - spec->warm;
+    sample_totals *counted = &result->counted;
+    double sum[3] = { 0, 0, 0 };
+    double sum_sq[3] = { 0, 0, 0 };
+    trace_record record;
+    int i;
 
-            set_line line = query_set.lines[lineIndex];
+    bzero(result, sizeof(*result));
+    result->records = replayed;
 
-            if (line.valid) {
-                if (line.tag == input_tag) { /* found the right tag - cache hit */
+    for (;;) {
+        double rate[3];
+        long long n;
 
-                    line.access_count++;
-                    
-                    par.hits++;
-                    
-                    query_set.lines[lineIndex] = line;
-                }
+        n = skip_records(reader, gap);
+        result->records += n;
+        if (n < gap) {
+            break;
+        }
+        for (n = 0; n < spec->warm && next_record(reader, &record); n++) {
+            replay_record(this_cache, par, &record);
+        }
+        result->records += n;
+        if (n < spec->warm) {
+            break;
+        }
 
-            } else if (!(line.valid) && (cache_full)) {
-                cache_full = 0;     
-            }
-        }   
+        /* par only ever holds one sample, so its int counters can't wrap */
+        par->hits = par->misses = par->evictions = par->dirty_evictions = par->extra_lookups = 0;
+        par->bytes_written = 0;
+        for (n = 0; n < spec->unit && next_record(reader, &record); n++) {
+            replay_record(this_cache, par, &record);
+        }
+        result->records += n;
+        if (n < spec->unit) {
+            break; /* a cut-off sample at the end of the trace isn't comparable */
+        }
 
-        if (prev_hits == par.hits) { /* par.hits wasn't incremented, so hit wasn't found - cache miss */
-            
-            par.misses++; 
-            
-        } else {
-            return par; /* data was hit and is already in cache, exit function */
+        counted->hits += par->hits;
+        counted->misses += par->misses;
+        counted->evictions += par->evictions;
+        counted->dirty_evictions += par->dirty_evictions;
+        counted->bytes_written += par->bytes_written;
+        counted->extra_lookups += par->extra_lookups;
+
+        rate[0] = (double) par->hits / spec->unit;
+        rate[1] = (double) par->misses / spec->unit;
+        rate[2] = (double) par->evictions / spec->unit;
+        for (i = 0; i < 3; i++) {
+            sum[i] += rate[i];
+            sum_sq[i] += rate[i] * rate[i];
         }
+        result->samples++;
+        result->measured += spec->unit;
+    }
 
-        /* we didn't find a hit, so continue with cache miss
-         * evict by getting LRU/ writing to first empty line in this set
-         */
+    /* every record after -k is estimated at the samples' average rate */
+    if (result->measured > 0) {
+        result->estimate.hits = scale_count(counted->hits, result->records, result->measured);
+        result->estimate.misses = scale_count(counted->misses, result->records, result->measured);
+        result->estimate.evictions = scale_count(counted->evictions, result->records, result->measured);
+        result->estimate.dirty_evictions = scale_count(counted->dirty_evictions, result->records, result->measured);
+        result->estimate.bytes_written = scale_count(counted->bytes_written, result->records, result->measured);
+        result->estimate.extra_lookups = scale_count(counted->extra_lookups, result->records, result->measured);
+    }
+    par->hits = clamp_count(counted->hits);
+    par->misses = clamp_count(counted->misses);
+    par->evictions = clamp_count(counted->evictions);
+    par->dirty_evictions = clamp_count(counted->dirty_evictions);
+    par->bytes_written = counted->bytes_written;
+    par->extra_lookups = clamp_count(counted->extra_lookups);
+    result->hits_ci = sample_ci(sum[0], sum_sq[0], result->samples, result->records);
+    result->misses_ci = sample_ci(sum[1], sum_sq[1], result->samples, result->records);
+    result->evictions_ci = sample_ci(sum[2], sum_sq[2], result->samples, result->records);
+} /* end run_sampled */
 
-        int *used_lines = (int*) malloc(sizeof(int) * 2);
-        int min_used_index = get_LRU(query_set, par, used_lines);   
+/* one -i row: the interval that ends after accesses lookups, with the
+ * marker's id when a marker record ended it
+ */
+void write_interval(FILE *out, long long accesses, const cache_param_t *par, const cache_param_t *last,
+                    const trace_record *marker)
+{
+    fprintf(out, "%lld,%d,%d,%d,", accesses,
+            par->hits - last->hits, par->misses - last->misses, par->evictions - last->evictions);
+    if (marker != NULL) {
+        fprintf(out, "0x%llx", marker->address);
+    }
+    fprintf(out, "\n");
+    fflush(out); /* rows are rare, and whoever tails the file wants them now */
+}
 
-        if (cache_full) { /* if there are no empty lines in cache, must overwrite */
-        
-            par.evictions++;
+/* replay the trace and write a CSV row every interval lookups and at
+ * every marker. the countdown is charged with the lookups each record made
+ * (hits plus misses), so an M counts twice and, under -z, an access that
+ * crosses blocks counts once per block, like the accesses column. a marker
+ * adds a weight large enough that the row is always due, so each record
+ * costs a table lookup and one compare; telling markers apart only happens
+ * once a row is written
+ */
+void run_intervals(trace_reader *reader, cache *this_cache, cache_param_t *par, long long interval, FILE *out)
+{
+    long long marker_weight[256];
+    long long period = (interval > 0) ? interval : LLONG_MAX / 4;
+    long long next_row = period; /* lookups at which the next row is due */
+    long long lookups;
+    cache_param_t last = *par;
+    trace_record record;
+    int i;
 
-            /* write and replace LRU */
-            query_set.lines[min_used_index].tag = input_tag;
-            query_set.lines[min_used_index].access_count = used_lines[1] + 1;
-        } else { /* there is at least one empty line we can write to */
+    for (i = 0; i < 256; i++) {
+        marker_weight[i] = 0;
+    }
+    marker_weight['X'] = LLONG_MAX / 2;
 
-            int empty_line_index = get_empty_line(query_set, par);
+    fprintf(out, "accesses,hits,misses,evictions,marker\n");
+    while (next_record(reader, &record)) {
+        replay_record(this_cache, par, &record);
+        lookups = (long long) par->hits + par->misses;
+        if (lookups + marker_weight[(unsigned char) record.op] < next_row) {
+            continue;
+        }
+        if (record.op == 'X') {
+            next_row = lookups + period; /* markers restart the period */
+        } else {
+            while (next_row <= lookups) {
+                next_row += period;
+            }
+        }
+        write_interval(out, lookups, par, &last, record.op == 'X' ? &record : NULL);
+        last = *par;
+    }
 
-            // update valid/ tag bits with the input cache's at the empty line 
-            query_set.lines[empty_line_index].tag = input_tag;
-            query_set.lines[empty_line_index].valid = 1;
-            query_set.lines[empty_line_index].access_count = used_lines[1] + 1;
-        }                       
+    /* the tail after the last full interval */
+    if (par->hits + par->misses != last.hits + last.misses) {
+        write_interval(out, (long long) par->hits + par->misses, par, &last, NULL);
+    }
+} /* end run_intervals */
 
-        free(used_lines);
-        return par;
+/* most misses first, then by address */
+int compare_pc_entries(const void *a, const void *b)
+{
+    const pc_entry *x = (const pc_entry *) a;
+    const pc_entry *y = (const pc_entry *) b;
 
-} /* end simulate_cache */
+    if (x->stats.misses != y->stats.misses) {
+        return (x->stats.misses > y->stats.misses) ? -1 : 1;
+    }
+    return (x->pc > y->pc) - (x->pc < y->pc);
+}
 
-/* instead of explicitly defining similar to pow(2.0, exp), just bit shift */
-long long bit_pow(int power) {
-    long long result = 1;
-    result = result << power;
-    return result;
-} 
+/* -P: every instruction that made a data access. returns -1 if path can't be written */
+int write_pc_stats(const char *path, const pc_map *map, int classify)
+{
+    pc_entry *entries = (pc_entry *) malloc(sizeof(pc_entry) * (map->count + 1));
+    int json = stats_format_json(path);
+    FILE *out;
+    char key[24];
+    long long num_entries = 0;
+    long long i;
+
+    for (i = 0; i < map->capacity; i++) {
+        const access_stats *stats = &map->stats[i];
+        if (map->keys[i] != 0 && stats->hits + stats->misses > 0) {
+            entries[num_entries].pc = map->keys[i] - 1;
+            entries[num_entries].stats = *stats;
+            num_entries++;
+        }
+    }
+    qsort(entries, num_entries, sizeof(pc_entry), compare_pc_entries);
+
+    if ((out = fopen(path, "w")) == NULL) {
+        free(entries);
+        return -1;
+    }
+    write_stats_frame(out, json, classify, "pc", 1);
+    for (i = 0; i < num_entries; i++) {
+        sprintf(key, json ? "\"0x%llx\"" : "0x%llx", entries[i].pc);
+        write_stats_row(out, json, classify, "pc", key, &entries[i].stats, i == 0);
+    }
+    write_stats_frame(out, json, classify, "pc", 0);
+    free(entries);
+    return fclose(out) == 0 ? 0 : -1;
+} /* end write_pc_stats */
 
 /* main takes commands as input and prints the cache hits, misses, and evictions */
+/* tune.c and other in-process drivers bring their own main */
+#ifndef CSIM_NO_MAIN
 int main(int argc, char **argv)
 {
     cache this_cache;
@@ -297,15 +3927,51 @@ int main(int argc, char **argv)
     long long num_sets;
     long long block_size;
 
-    FILE *read_trace;
+    trace_reader reader;
+    trace_record record;
+
+    char *trace_file = NULL;
+    char *convert_file = NULL; /* -T output */
+    int delta = 0;             /* -D */
 
-    char cmd; /* cmd will take in the operation address I, L, S, or M */
-    mem_addr_t address;
-    int size;
+    cache_param_t *sweep_pars = NULL; /* -S configurations */
+    int num_sweep_pars = 0;
+    int max_E = 0;                    /* -A */
+    char *lookup_name = "auto";       /* -l */
+    int num_shards = 1;               /* -j */
+    char *policy_name = "lru";        /* -p */
+    const replacement_policy *policy;
+    int write_mode = -1;              /* -W flags, -1 when not given */
+    cache_level levels[MAX_LEVELS];   /* L1 from -s/-E/-b/-p, then each -L */
+    int num_levels = 1;
+    int split_blocks = 0;             /* -z */
+    char *set_stats_file = NULL;      /* -H */
+    char *pc_stats_file = NULL;       /* -P */
+    access_stats *set_stats = NULL;
+    pc_map pcs;
+    int classify = 0;                 /* -C */
+    shadow_cache shadow;
+    access_stats miss_classes;        /* -C totals over every set */
+    prefetcher *pf = NULL;            /* -F */
+    long long skip_count = 0;         /* -k */
+    long long warm_count = 0;         /* -w */
+    long long warmed = 0;
+    sample_spec sample;               /* -m */
+    sample_result sampled;
+    int sampling = 0;
+    long long interval = -1;          /* -i, -1 when not given */
+    char *interval_file = NULL;       /* -I */
+    FILE *interval_out = stdout;
+    char *save_file = NULL;           /* -o */
+    long long save_after = -1;        /* -o file:N, -1 for the whole trace */
+    long long replayed = 0;
+    char *restore_file = NULL;        /* -r */
+    checkpoint_info checkpoint;
+    int policy_given = 0;
+    int k;
 
-    char *trace_file;
     char c;
-    while( (c=getopt(argc,argv,"s:E:b:t:vh")) != -1){
+    while( (c=getopt(argc,argv,"s:E:b:t:T:S:A:l:j:p:L:W:H:P:F:k:w:m:i:I:o:r:CDzvh")) != -1){
         switch(c){
         case 's':
             par.s = atoi(optarg);
@@ -319,6 +3985,98 @@ int main(int argc, char **argv)
         case 't':
             trace_file = optarg;
             break;
+        case 'T':
+            convert_file = optarg;
+            break;
+        case 'D':
+            delta = 1;
+            break;
+        case 'z':
+            split_blocks = 1;
+            break;
+        case 'H':
+            set_stats_file = optarg;
+            break;
+        case 'P':
+            pc_stats_file = optarg;
+            break;
+        case 'C':
+            classify = 1;
+            break;
+        case 'i':
+            interval = atoll(optarg);
+            break;
+        case 'I':
+            interval_file = optarg;
+            break;
+        case 'o':
+            if (parse_save_spec(optarg, &save_after) < 0) {
+                printf("%s: Invalid checkpoint spec %s\n", argv[0], optarg);
+                exit(1);
+            }
+            save_file = optarg;
+            break;
+        case 'r':
+            restore_file = optarg;
+            break;
+        case 'k':
+            skip_count = atoll(optarg);
+            break;
+        case 'w':
+            warm_count = atoll(optarg);
+            break;
+        case 'm':
+            if (parse_sample_spec(optarg, &sample) < 0) {
+                printf("%s: Invalid sample spec %s\n", argv[0], optarg);
+                exit(1);
+            }
+            sampling = 1;
+            break;
+        case 'F':
+            if (pf == NULL) {
+                pf = (prefetcher *) malloc(sizeof(prefetcher));
+            }
+            if (parse_prefetch_spec(optarg, pf) < 0) {
+                printf("%s: Invalid prefetcher %s\n", argv[0], optarg);
+                exit(1);
+            }
+            break;
+        case 'A':
+            max_E = atoi(optarg);
+            break;
+        case 'l':
+            lookup_name = optarg;
+            break;
+        case 'j':
+            num_shards = atoi(optarg);
+            break;
+        case 'p':
+            policy_name = optarg;
+            policy_given = 1;
+            break;
+        case 'W':
+            if ((write_mode = parse_write_mode(optarg)) < 0) {
+                printf("%s: Unknown write policy %s\n", argv[0], optarg);
+                exit(1);
+            }
+            break;
+        case 'L':
+            if (num_levels == MAX_LEVELS || parse_level_spec(optarg, &levels[num_levels]) < 0) {
+                printf("%s: Invalid cache level %s\n", argv[0], optarg);
+                exit(1);
+            }
+            num_levels++;
+            break;
+        case 'S':
+            if (sweep_pars == NULL) {
+                sweep_pars = (cache_param_t *) malloc(sizeof(cache_param_t) * MAX_SWEEP_CONFIGS);
+            }
+            num_sweep_pars = parse_sweep_spec(optarg, sweep_pars, num_sweep_pars);
+            if (num_sweep_pars < 0) {
+                printf("%s: Invalid sweep spec %s\n", argv[0], optarg);
+                exit(1);
+            }
+            break;
         case 'v':
             verbosity = 1;
             break;
@@ -330,51 +4088,329 @@ int main(int argc, char **argv)
             exit(1);
         }
     }
+    if ((tag_lookup = select_tag_lookup(lookup_name)) == NULL) {
+        printf("%s: Tag lookup %s is not available\n", argv[0], lookup_name);
+        exit(1);
+    }
+
+    if ((policy = find_policy(policy_name)) == NULL) {
+        printf("%s: Unknown replacement policy %s\n", argv[0], policy_name);
+        exit(1);
+    }
+
+    /* -T only rewrites the trace, no cache parameters needed */
+    if (convert_file != NULL && trace_file != NULL) {
+        long long num_records;
+
+        if (open_trace(&reader, trace_file) < 0) {
+            printf("%s: Could not open trace file %s\n", argv[0], trace_file);
+            exit(1);
+        }
+        num_records = convert_trace(&reader, convert_file, delta);
+        close_trace(&reader);
+
+        if (num_records < 0) {
+            printf("%s: Could not convert %s to %s\n", argv[0], trace_file, convert_file);
+            exit(1);
+        }
+        if (verbosity) {
+            fprintf(stderr, "%lld records written to %s\n", num_records, convert_file);
+        }
+        return 0;
+    }
+
+    /* the instrumented loop only knows how to replay a single cache */
+    if ((set_stats_file != NULL || pc_stats_file != NULL || classify) &&
+        (sweep_pars != NULL || max_E > 0 || num_levels > 1 || num_shards > 1)) {
+        printf("%s: -H, -P and -C can't be combined with -S, -A, -L or -j\n", argv[0]);
+        exit(1);
+    }
+    if (pf != NULL && (set_stats_file != NULL || pc_stats_file != NULL || classify ||
+                       sweep_pars != NULL || max_E > 0 || num_levels > 1 || num_shards > 1)) {
+        printf("%s: -F can't be combined with -H, -P, -C, -S, -A, -L or -j\n", argv[0]);
+        exit(1);
+    }
+    if ((skip_count > 0 || warm_count > 0 || sampling) &&
+        (convert_file != NULL || sweep_pars != NULL || max_E > 0 || num_levels > 1)) {
+        printf("%s: -k, -w and -m only apply to a single cache\n", argv[0]);
+        exit(1);
+    }
+    if (sampling && (set_stats_file != NULL || pc_stats_file != NULL || classify || pf != NULL || num_shards > 1)) {
+        printf("%s: -m can't be combined with -H, -P, -C, -F or -j\n", argv[0]);
+        exit(1);
+    }
+    if (interval >= 0 && (convert_file != NULL || sweep_pars != NULL || max_E > 0 || num_levels > 1 || sampling ||
+                          set_stats_file != NULL || pc_stats_file != NULL || classify || pf != NULL || num_shards > 1)) {
+        printf("%s: -i only applies to a plain single cache run\n", argv[0]);
+        exit(1);
+    }
+    if ((save_file != NULL || restore_file != NULL) &&
+        (convert_file != NULL || sweep_pars != NULL || max_E > 0 || num_levels > 1 || classify)) {
+        printf("%s: -o and -r only apply to a single cache, without -C\n", argv[0]);
+        exit(1);
+    }
+    if (save_file != NULL && (sampling || interval >= 0 || set_stats_file != NULL ||
+                              pc_stats_file != NULL || pf != NULL || num_shards > 1)) {
+        printf("%s: -o only applies to a plain single cache run\n", argv[0]);
+        exit(1);
+    }
+
+    /* -r: the checkpoint brings its own geometry and policy, -s/-E/-b/-p may only repeat them */
+    if (restore_file != NULL) {
+        if (load_checkpoint(restore_file, &this_cache, &checkpoint) < 0) {
+            printf("%s: Could not restore checkpoint %s\n", argv[0], restore_file);
+            exit(1);
+        }
+        if ((par.s != 0 && par.s != checkpoint.par.s) || (par.E != 0 && par.E != checkpoint.par.E) ||
+            (par.b != 0 && par.b != checkpoint.par.b) || (policy_given && policy != checkpoint.policy)) {
+            printf("%s: -s/-E/-b/-p don't match checkpoint %s\n", argv[0], restore_file);
+            exit(1);
+        }
+        par.s = checkpoint.par.s;
+        par.E = checkpoint.par.E;
+        par.b = checkpoint.par.b;
+        policy = checkpoint.policy;
+        if (verbosity) {
+            fprintf(stderr, "restored %s after %lld records: hits:%d misses:%d evictions:%d\n",
+                    restore_file, checkpoint.records, checkpoint.par.hits, checkpoint.par.misses,
+                    checkpoint.par.evictions);
+        }
+    } else {
+        bzero(&checkpoint, sizeof(checkpoint));
+    }
+
+    /* -S replaces the single -s/-E/-b configuration */
+    if (sweep_pars != NULL && trace_file != NULL) {
+        for (k = 0; k < num_sweep_pars; k++) {
+            if (!policy_supports(policy, sweep_pars[k].E)) {
+                printf("%s: Policy %s can't manage %d lines per set\n", argv[0], policy->name, sweep_pars[k].E);
+                exit(1);
+            }
+            sweep_pars[k].split_blocks = split_blocks;
+        }
+        if (open_trace(&reader, trace_file) < 0) {
+            printf("%s: Could not open trace file %s\n", argv[0], trace_file);
+            exit(1);
+        }
+        run_sweep(&reader, sweep_pars, num_sweep_pars, policy, write_mode);
+        close_trace(&reader);
+        free(sweep_pars);
+        return 0;
+    }
+
+    /* -A needs s and b, but covers every E up to max_E */
+    if (max_E > 0 && par.s != 0 && par.b != 0 && trace_file != NULL) {
+        if (strcmp(policy->name, "lru") != 0) {
+            printf("%s: -A only models LRU\n", argv[0]);
+            exit(1);
+        }
+        if (open_trace(&reader, trace_file) < 0) {
+            printf("%s: Could not open trace file %s\n", argv[0], trace_file);
+            exit(1);
+        }
+        run_stack_distance(&reader, par.s, par.b, max_E, split_blocks);
+        close_trace(&reader);
+        return 0;
+    }
+
     if (par.s == 0 || par.E == 0 || par.b == 0 || trace_file == NULL) {
         printf("%s: Missing required command line argument\n", argv[0]);
         printUsage(argv);
         exit(1);
     }
 
+    if (!policy_supports(policy, par.E)) {
+        printf("%s: Policy %s can't manage %d lines per set\n", argv[0], policy->name, par.E);
+        exit(1);
+    }
+
+    /* every shard needs at least one set */
+    if (num_shards < 1 || num_shards > MAX_SHARDS || num_shards > bit_pow(par.s)) {
+        printf("%s: -j must be between 1 and min(%d, 2^s)\n", argv[0], MAX_SHARDS);
+        exit(1);
+    }
+
+    /* -L: the -s/-E/-b/-p cache is L1 and only the summary of every level is printed */
+    if (num_levels > 1) {
+        if (num_shards > 1) {
+            printf("%s: -j can't be combined with -L\n", argv[0]);
+            exit(1);
+        }
+        bzero(&levels[0], sizeof(levels[0]));
+        levels[0].par = par;
+        levels[0].par.split_blocks = split_blocks;
+        levels[0].par.S = 1 << par.s;
+        levels[0].par.B = 1 << par.b;
+        levels[0].level_cache.policy = policy;
+        levels[0].inclusion = INCLUSION_NINE;
+
+        /* back-invalidation and victim hand-offs move one block at a time */
+        for (k = 1; k < num_levels; k++) {
+            int i;
+
+            for (i = 0; i < k && levels[k].inclusion != INCLUSION_NINE; i++) {
+                if (levels[i].par.b != levels[k].par.b) {
+                    printf("%s: Inclusive and exclusive -L levels need the block size of every level above\n",
+                           argv[0]);
+                    exit(1);
+                }
+            }
+        }
+
+        if (open_trace(&reader, trace_file) < 0) {
+            printf("%s: Could not open trace file %s\n", argv[0], trace_file);
+            exit(1);
+        }
+        run_hierarchy(&reader, levels, num_levels);
+        close_trace(&reader);
+        return 0;
+    }
+
     /* compute S and B based on information passed in; S = 2^s and B = 2^b */
     num_sets = pow(2.0, par.s);
     block_size = bit_pow(par.b); 
     par.hits = 0;
     par.misses = 0;
     par.evictions = 0;
+    par.split_blocks = split_blocks;
+
+    if (open_trace(&reader, trace_file) < 0) {
+        printf("%s: Could not open trace file %s\n", argv[0], trace_file);
+        exit(1);
+    }
 
-    this_cache = build_cache(num_sets, par.E, block_size); /* build_cache takes as input sets, lines, and blocks */
+    if (restore_file == NULL) {
+        this_cache = build_cache(num_sets, par.E, block_size, policy); /* build_cache takes as input sets, lines, and blocks */
+        set_write_policy(&this_cache, write_mode < 0 ? 0 : write_mode);
+    } else if (write_mode >= 0) {
+        set_write_policy(&this_cache, write_mode);
+    }
 
-    read_trace = fopen(trace_file,"r");
+    /* -k and -w: fast-forward, then fill the cache without counting */
+    skip_records(&reader, skip_count);
+    while (warmed < warm_count && next_record(&reader, &record)) {
+        replay_record(&this_cache, &par, &record);
+        warmed++;
+    }
+    par.hits = par.misses = par.evictions = par.dirty_evictions = par.extra_lookups = 0;
+    par.bytes_written = 0;
 
     /* rest of simulator routine reads commands in */
-   	if (read_trace != NULL) {
-        while (fscanf(read_trace, " %c %llx,%d", &cmd, &address, &size) == 3) {
-            switch(cmd) {
-                case 'I':
-                break;
-                case 'L':
-                    par = simulate_cache(this_cache, par, address);
-                break;
-                case 'S':
-                    par = simulate_cache(this_cache, par, address);
-                break;
-                case 'M':
-                    par = simulate_cache(this_cache, par, address);
-                    par = simulate_cache(this_cache, par, address);	
-                break;
-                default:
-                break;
+    if (sampling) {
+        run_sampled(&reader, &this_cache, &par, &sample, warmed, &sampled);
+    } else if (interval >= 0) {
+        if (interval_file != NULL && (interval_out = fopen(interval_file, "w")) == NULL) {
+            printf("%s: Could not write %s\n", argv[0], interval_file);
+            exit(1);
+        }
+        run_intervals(&reader, &this_cache, &par, interval, interval_out);
+        if (interval_out != stdout) {
+            fclose(interval_out);
+        }
+    } else if (num_shards > 1) {
+        if (run_sharded(&reader, &this_cache, &par, num_shards) < 0) {
+            printf("%s: Could not start %d simulation threads\n", argv[0], num_shards);
+            exit(1);
+        }
+    } else if (pf != NULL) {
+        run_prefetch(&reader, &this_cache, &par, pf);
+    } else if (set_stats_file != NULL || pc_stats_file != NULL || classify) {
+        set_stats = (access_stats *) calloc(num_sets, sizeof(access_stats));
+        if (pc_stats_file != NULL) {
+            pcs.capacity = 1 << 12;
+            pcs.count = 0;
+            pcs.keys = (mem_addr_t *) calloc(pcs.capacity, sizeof(mem_addr_t));
+            pcs.stats = (access_stats *) malloc(sizeof(access_stats) * pcs.capacity);
+        }
+        if (classify) {
+            build_shadow(&shadow, num_sets * par.E);
+        }
+        run_instrumented(&reader, &this_cache, &par, set_stats, pc_stats_file != NULL ? &pcs : NULL,
+                         classify ? &shadow : NULL);
+
+        if (set_stats_file != NULL && write_set_stats(set_stats_file, set_stats, num_sets, classify) < 0) {
+            printf("%s: Could not write %s\n", argv[0], set_stats_file);
+            exit(1);
+        }
+        if (pc_stats_file != NULL) {
+            if (write_pc_stats(pc_stats_file, &pcs, classify) < 0) {
+                printf("%s: Could not write %s\n", argv[0], pc_stats_file);
+                exit(1);
+            }
+            free(pcs.keys);
+            free(pcs.stats);
+        }
+        if (classify) {
+            bzero(&miss_classes, sizeof(miss_classes));
+            for (k = 0; k < num_sets; k++) {
+                add_stats(&miss_classes, &set_stats[k]);
             }
+            clear_shadow(&shadow);
+        }
+        free(set_stats);
+    } else {
+        while ((save_after < 0 || replayed < save_after) && next_record(&reader, &record)) {
+            replay_record(&this_cache, &par, &record);
+            replayed++;
+        }
+    }
+
+    /* -o: the checkpoint's counters run across every -r/-o generation */
+    if (save_file != NULL) {
+        checkpoint.records += warmed + replayed;
+        checkpoint.par.s = par.s;
+        checkpoint.par.E = par.E;
+        checkpoint.par.b = par.b;
+        checkpoint.par.hits += par.hits;
+        checkpoint.par.misses += par.misses;
+        checkpoint.par.evictions += par.evictions;
+        checkpoint.par.dirty_evictions += par.dirty_evictions;
+        checkpoint.par.bytes_written += par.bytes_written;
+        checkpoint.par.extra_lookups += par.extra_lookups;
+        checkpoint.write_mode = (this_cache.write_through ? WRITE_THROUGH : 0) |
+                                (this_cache.write_allocate ? 0 : WRITE_NO_ALLOCATE);
+        if (write_checkpoint(save_file, &this_cache, &checkpoint) < 0) {
+            printf("%s: Could not write checkpoint %s\n", argv[0], save_file);
+            exit(1);
         }
     }
 
     /* print out real results */
     printSummary(par.hits, par.misses, par.evictions);
+    if (write_mode >= 0) {
+        printWriteSummary(&par);
+    }
+    if (split_blocks) {
+        printf("extra_lookups:%d\n", par.extra_lookups);
+    }
+    if (classify) {
+        printf("compulsory:%d capacity:%d conflict:%d\n",
+               miss_classes.compulsory, miss_classes.capacity, miss_classes.conflict);
+    }
+    if (pf != NULL) {
+        printf("prefetches:%d useful:%d late:%d polluting:%d\n", pf->issued, pf->useful, pf->late, pf->polluting);
+        free(pf);
+    }
+    if (sampling) {
+        printf("estimated_hits:%lld estimated_misses:%lld estimated_evictions:%lld",
+               sampled.estimate.hits, sampled.estimate.misses, sampled.estimate.evictions);
+        if (write_mode >= 0) {
+            printf(" estimated_dirty_evictions:%lld estimated_bytes_written:%lld",
+                   sampled.estimate.dirty_evictions, sampled.estimate.bytes_written);
+        }
+        if (split_blocks) {
+            printf(" estimated_extra_lookups:%lld", sampled.estimate.extra_lookups);
+        }
+        printf("\n");
+        printf("samples:%d records:%lld measured:%lld hits_ci:%lld misses_ci:%lld evictions_ci:%lld\n",
+               sampled.samples, sampled.records, sampled.measured,
+               sampled.hits_ci, sampled.misses_ci, sampled.evictions_ci);
+    }
 
     /* clean up cache resources */
     clear_cache(this_cache, num_sets, par.E, block_size);
-    fclose(read_trace);
+    close_trace(&reader);
 
     return 0;
 }
+#endif /* CSIM_NO_MAIN */
@@ -0,0 +1,134 @@
+/*
+ * csim.h - the simulation engine of csim.c, for programs that replay
+ *     accesses in-process instead of through a trace (tune.c, bench.c,
+ *     simbench.c). compile csim.c with -DCSIM_NO_MAIN and link it in:
+ *
+ *     gcc -O2 -std=c99 -DCSIM_NO_MAIN -o simbench simbench.c csim.c cachelab.c -lm -lpthread
+ *
+ * tune.c also links trans.c, built with -DCSIM_TRACE so the kernel's own
+ * accesses reach the engine (csim_trace.h):
+ *
+ *     gcc -O2 -std=c99 -DCSIM_NO_MAIN -DCSIM_TRACE -o tune tune.c trans.c csim.c cachelab.c -lm -lpthread
+ *
+ * build_cache() a geometry, feed addresses to simulate_cache() (loads) or
+ * simulate_store(), read the counters out of the cache_param_t, then
+ * clear_cache(). cache_param_t needs s, E and b filled in and the counters
+ * zeroed before the first access.
+ *
+ * Author: Iris Yuan
+ */
+#ifndef CSIM_H
+#define CSIM_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* always use a 64-bit variable to hold memory addresses*/
+typedef unsigned long long int mem_addr_t;
+
+typedef struct replacement_policy replacement_policy;
+
+/* the whole cache lives in one arena, stored as separate arrays so a
+ * tag probe only touches tags. line `way` of set `set` is at index
+ * set * E + way in tags and valid (LINE_* flags); the set's replacement
+ * metadata is the meta_bytes starting at meta + set * meta_bytes
+ */
+typedef struct {
+    mem_addr_t *tags;
+    unsigned char *meta;
+    unsigned char *valid;
+    int meta_bytes;           /* replacement metadata per set */
+    const replacement_policy *policy;
+    unsigned long long clock; /* last stamp handed out, for lru and fifo */
+    mem_addr_t evicted;       /* block address of the last eviction */
+    unsigned char evicted_flags; /* valid byte of the last victim */
+    int write_through;        /* stores go straight to memory, lines never get dirty */
+    int write_allocate;       /* a store miss fills the line like a load would */
+    char *mapping;            /* -r checkpoint the arena lives in, NULL if calloc'd */
+    size_t mapping_len;
+} cache;
+
+/* a replacement policy works only on one set's metadata. hits call touch,
+ * filling a line after a miss calls fill, and a miss in a full set asks
+ * victim which way to evict
+ */
+struct replacement_policy {
+    const char *name;
+    int pow2_ways;                       /* E must be a power of two <= 64 */
+    int (*meta_bytes)(int num_lines);
+    void (*touch)(cache *this_cache, unsigned char *meta, int way, int num_lines);
+    void (*fill)(cache *this_cache, unsigned char *meta, int way, int num_lines);
+    int (*victim)(cache *this_cache, unsigned char *meta, int num_lines);
+};
+
+/* a struct that groups cache parameters together 
+ * (given from lab - added parameters to count hits, misses, evictions) 
+ */
+typedef struct {
+    int s; /* 2**s cache sets */
+    int b; /* cacheline block size 2**b bytes */
+    int E; /* number of cachelines per set */
+    int S; /* number of sets, derived from S = 2**s */
+    int B; /* cacheline block size (bytes), derived from B = 2**b */
+    
+    int hits;
+    int misses;
+    int evictions;
+
+    int dirty_evictions;      /* evictions that had to write the line back */
+    long long bytes_written;  /* bytes sent to memory: write-backs and write-throughs */
+
+    int split_blocks;         /* -z: split accesses at block boundaries */
+    int extra_lookups;        /* lookups beyond the first block of an access */
+} cache_param_t;
+
+/* flags kept in a line's valid byte, bit 0 alone says whether it is valid */
+#define LINE_VALID 1
+#define LINE_DIRTY 2
+#define LINE_PREFETCHED 4 /* filled by -F and not used by a demand access yet */
+
+/* -W write policies, as bit flags; 0 is write-back with write-allocate */
+#define WRITE_THROUGH 1
+#define WRITE_NO_ALLOCATE 2
+
+/* simulate_cache() results */
+#define CACHE_HIT 0
+#define CACHE_MISS 1        /* missed and filled an empty line */
+#define CACHE_MISS_EVICT 2  /* missed and evicted the line at cache.evicted */
+
+/* one decoded trace record, e.g. " M 0421c7f0,4" */
+typedef struct {
+    char op; /* I, L, S, or M */
+    mem_addr_t address;
+    int size;
+} trace_record;
+
+/* binary trace header flag: addresses are zigzag varint deltas (csim.c) */
+#define TRACE_FLAG_DELTA 1
+
+/* sets with at least this many lines use the vectorized tag lookup */
+#define SIMD_MIN_WAYS 8
+
+/* finds tag among the valid lines of a set. returns its way, or -1 and sets
+ * *empty_index to the first invalid way (-1 if the set is full)
+ */
+typedef int (*tag_lookup_fn)(const mem_addr_t *tags, const unsigned char *valid,
+                             int num_lines, mem_addr_t tag, int *empty_index);
+
+/* the engine, see csim.c */
+extern int verbosity;
+extern tag_lookup_fn tag_lookup; /* what simulate_cache() uses, scalar until set */
+tag_lookup_fn select_tag_lookup(const char *name); /* auto, avx2, sse4, neon, scalar; NULL if unavailable */
+long long bit_pow(int power);
+const replacement_policy *find_policy(const char *name);
+int policy_supports(const replacement_policy *policy, int num_lines);
+cache build_cache(long long num_sets, int num_lines, long long block_size, const replacement_policy *policy);
+void clear_cache(cache this_cache, long long num_sets, int num_lines, long long block_size);
+void set_write_policy(cache *this_cache, int write_mode);
+int simulate_cache(cache *this_cache, cache_param_t *par, mem_addr_t address);
+int simulate_store(cache *this_cache, cache_param_t *par, mem_addr_t address, int size);
+int parse_write_mode(const char *name);
+void write_trace_header(FILE *out, unsigned int flags);
+void write_trace_record(FILE *out, const trace_record *record, int delta, mem_addr_t *prev_address);
+
+#endif
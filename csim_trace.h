@@ -0,0 +1,60 @@
+/*
+ * csim_trace.h - in-process trace capture. code written against these
+ *     accessors compiles to plain loads and stores, unless it is built with
+ *     -DCSIM_TRACE and linked with csim.c (-DCSIM_NO_MAIN): then every
+ *     access is also handed straight to csim's engine, with no valgrind and
+ *     no trace file. replaying a transpose this way costs a function call
+ *     per access, so a 64x64 candidate takes well under a millisecond.
+ *
+ *     TRACE_STORE(B[j][i], TRACE_LOAD(A[i][j]));   for   B[j][i] = A[i][j];
+ *
+ * the lvalue is evaluated twice, so it must have no side effects. between
+ * csim_trace_begin() and csim_trace_end() accesses are simulated at their
+ * offset from base, so results don't depend on where the process put the
+ * matrices; outside of it they only cost the flag check.
+ *
+ * Author: Iris Yuan
+ */
+#ifndef CSIM_TRACE_H
+#define CSIM_TRACE_H
+
+#include "csim.h"
+
+/* the capture itself lives in csim.c and is always declared; only the
+ * accessors below depend on -DCSIM_TRACE
+ */
+extern cache csim_trace_cache;
+extern cache_param_t csim_trace_par;
+extern const char *csim_trace_base;
+extern int csim_trace_on;
+
+/* start simulating a cold s:E:b cache; -1 if policy can't manage E lines */
+int csim_trace_begin(int s, int E, int b, const replacement_policy *policy, int write_mode, const void *base);
+/* stop, copy the counters out and free the cache */
+void csim_trace_end(cache_param_t *counts);
+
+#ifdef CSIM_TRACE
+static inline void csim_trace_access(const void *p, int size, int store)
+{
+    mem_addr_t address;
+
+    if (!csim_trace_on) {
+        return;
+    }
+    address = (mem_addr_t) ((const char *) p - csim_trace_base);
+    if (store) {
+        simulate_store(&csim_trace_cache, &csim_trace_par, address, size);
+    } else {
+        simulate_cache(&csim_trace_cache, &csim_trace_par, address);
+    }
+}
+
+/* the store is recorded after its value is computed, so loads come first */
+#define TRACE_LOAD(lvalue) (csim_trace_access(&(lvalue), sizeof(lvalue), 0), (lvalue))
+#define TRACE_STORE(lvalue, value) ((lvalue) = (value), csim_trace_access(&(lvalue), sizeof(lvalue), 1))
+#else
+#define TRACE_LOAD(lvalue) (lvalue)
+#define TRACE_STORE(lvalue, value) ((lvalue) = (value))
+#endif
+
+#endif
@@ -0,0 +1,598 @@
+/*
+ * simbench.c - throughput benchmark for csim's engine. synthetic streams
+ *     (sequential, uniform random, zipfian, strided conflicts and a
+ *     transpose's loads and stores) are replayed through simulate_cache()
+ *     and simulate_store() over a grid of s:E:b geometries, policies and tag
+ *     lookups, one CSV (or JSON) row each: the counters, the best time of
+ *     -r runs, accesses per second, nanoseconds per access and peak RSS.
+ *
+ * every stream is generated before anything is timed, so only the engine
+ * is measured: a row builds a cold cache, replays the whole stream and frees
+ * the cache again. the tag lookup (-l) only matters for sets of
+ * SIMD_MIN_WAYS lines or more; narrower sets always take the scalar loop
+ * and get one row, with lookup "-". peak RSS is the kernel's high-water
+ * mark, reset before every row on linux (clear_refs), so it covers the
+ * arena plus the stream (-n times sizeof(trace_record)); elsewhere it is
+ * the peak of the whole process so far.
+ *
+ * trace reading, decompression and -j's shards live in csim's main, not
+ * in the engine. -T writes every stream as a binary trace so those can be
+ * timed on the same accesses: ./simbench -T /tmp/sb- && time ./csim -s 10
+ * -E 4 -b 6 -j 4 -t /tmp/sb-zipf.bin
+ *
+ * build:  gcc -O2 -std=c99 -DCSIM_NO_MAIN -o simbench simbench.c csim.c cachelab.c -lm -lpthread
+ * run:    ./simbench -o base.csv
+ *
+ * Author: Iris Yuan
+ */
+#define _GNU_SOURCE /* for clock_gettime under -std=c99 */
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <math.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "csim.h"
+
+#define MAX_GENERATORS 8
+#define MAX_GEOMETRIES 64
+#define MAX_POLICIES 8
+#define MAX_LOOKUPS 8
+
+#define REGION_BYTES (1ULL << 26)  /* seq and random stay inside 64MB */
+#define ZIPF_BLOCKS (1 << 20)      /* distinct 64-byte blocks zipf draws from */
+#define ZIPF_ALPHA 0.99
+#define STRIDE_STREAMS 32          /* stride: streams 64KB apart, all in the same sets */
+#define STRIDE_BYTES (1 << 16)
+#define TRANSPOSE_DIM 1024         /* transpose: int A[1024][1024], B right after it */
+
+/* fills n records of one synthetic stream */
+typedef void (*generator_fn)(trace_record *records, long n);
+
+typedef struct {
+    const char *name;
+    generator_fn generate;
+    const char *description;
+} generator;
+
+/* one result row */
+typedef struct {
+    const char *generator;
+    int s;
+    int E;
+    int b;
+    const char *policy;
+    const char *lookup;
+    long long accesses;
+    long long hits;
+    long long misses;
+    long long evictions;
+    double seconds;
+    double accesses_per_sec;
+    double ns_per_access;
+    long peak_rss_kb;
+} simbench_row;
+
+/* xorshift64*, seeded the same way for every stream so runs are repeatable */
+static unsigned long long rng_state;
+
+static void seed_random(void)
+{
+    rng_state = 0x9e3779b97f4a7c15ULL;
+}
+
+static unsigned long long next_random(void)
+{
+    rng_state ^= rng_state >> 12;
+    rng_state ^= rng_state << 25;
+    rng_state ^= rng_state >> 27;
+    return rng_state * 0x2545f4914f6cdd1dULL;
+}
+
+/* 8-byte loads walking up the region, wrapping at its end */
+static void generate_seq(trace_record *records, long n)
+{
+    long k;
+
+    for (k = 0; k < n; k++) {
+        records[k].op = 'L';
+        records[k].address = (8ULL * k) % REGION_BYTES;
+        records[k].size = 8;
+    }
+}
+
+/* 8-byte loads anywhere in the region */
+static void generate_random(trace_record *records, long n)
+{
+    long k;
+
+    for (k = 0; k < n; k++) {
+        records[k].op = 'L';
+        records[k].address = (next_random() % REGION_BYTES) & ~7ULL;
+        records[k].size = 8;
+    }
+}
+
+/* loads of ZIPF_BLOCKS blocks where the k-th most popular one is drawn in
+ * proportion to 1/k^ZIPF_ALPHA. ranks are scattered over the blocks by an
+ * odd multiplier, a bijection mod 2^20, so the hot blocks don't share sets
+ */
+static void generate_zipf(trace_record *records, long n)
+{
+    double *cdf = (double *) malloc(sizeof(double) * ZIPF_BLOCKS);
+    double total = 0;
+    long k;
+    int rank;
+
+    if (cdf == NULL) {
+        printf("simbench: Could not allocate the zipf table\n");
+        exit(1);
+    }
+    for (rank = 0; rank < ZIPF_BLOCKS; rank++) {
+        total += 1.0 / pow(rank + 1, ZIPF_ALPHA);
+        cdf[rank] = total;
+    }
+
+    for (k = 0; k < n; k++) {
+        double u = (next_random() >> 11) * (1.0 / 9007199254740992.0) * total;
+        int lo = 0;
+        int hi = ZIPF_BLOCKS - 1;
+        mem_addr_t block;
+
+        /* first rank whose cumulative weight reaches u */
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            if (cdf[mid] < u) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        block = ((mem_addr_t) lo * 2654435761ULL) & (ZIPF_BLOCKS - 1);
+        records[k].op = 'L';
+        records[k].address = block * 64 + (next_random() & 56);
+        records[k].size = 8;
+    }
+    free(cdf);
+} /* end generate_zipf */
+
+/* STRIDE_STREAMS sequential streams, interleaved, each STRIDE_BYTES after
+ * the last: with at most 16 index and offset bits they all map to the
+ * same set, so any E below STRIDE_STREAMS thrashes
+ */
+static void generate_stride(trace_record *records, long n)
+{
+    long k;
+
+    for (k = 0; k < n; k++) {
+        records[k].op = 'L';
+        records[k].address = (mem_addr_t) (k % STRIDE_STREAMS) * STRIDE_BYTES + 8ULL * (k / STRIDE_STREAMS);
+        records[k].size = 8;
+    }
+}
+
+/* B[j][i] = A[i][j] over TRANSPOSE_DIM squared ints: a row-wise load of A,
+ * then a column-wise store to B, repeated once B is done
+ */
+static void generate_transpose(trace_record *records, long n)
+{
+    mem_addr_t matrix_bytes = 4ULL * TRANSPOSE_DIM * TRANSPOSE_DIM;
+    long k;
+
+    for (k = 0; k + 1 < n; k += 2) {
+        long element = (k / 2) % ((long) TRANSPOSE_DIM * TRANSPOSE_DIM);
+        long i = element / TRANSPOSE_DIM;
+        long j = element % TRANSPOSE_DIM;
+
+        records[k].op = 'L';
+        records[k].address = 4ULL * (i * TRANSPOSE_DIM + j);
+        records[k].size = 4;
+        records[k + 1].op = 'S';
+        records[k + 1].address = matrix_bytes + 4ULL * (j * TRANSPOSE_DIM + i);
+        records[k + 1].size = 4;
+    }
+    if (k < n) {
+        records[k].op = 'L';
+        records[k].address = 0;
+        records[k].size = 4;
+    }
+} /* end generate_transpose */
+
+static const generator generators[] = {
+    { "seq", generate_seq, "sequential 8-byte loads" },
+    { "random", generate_random, "uniform 8-byte loads over 64MB" },
+    { "zipf", generate_zipf, "zipfian loads over 1M blocks" },
+    { "stride", generate_stride, "32 streams 64KB apart" },
+    { "transpose", generate_transpose, "1024x1024 int transpose" }
+};
+#define NUM_GENERATORS ((int) (sizeof(generators) / sizeof(generators[0])))
+
+/* the default grid: a tiny, a mid-size and an L2-ish number of sets, direct
+ * mapped to wide enough for the vector lookup, 32 and 64 byte blocks
+ */
+static const int default_s[] = { 5, 10, 14 };
+static const int default_E[] = { 1, 4, 16 };
+static const int default_b[] = { 5, 6 };
+
+/*
+ * printUsage - Print usage info
+ */
+static void printUsage(char* argv[])
+{
+    int g;
+
+    printf("Usage: %s [-hv] [-g <name> ...] [-c <s:E:b> ...] [-p <name> ...] [-l <name> ...] [-n <num>] [-o <file>]\n",
+           argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v         Print each row to stderr as it is measured.\n");
+    printf("  -g <name>  Replay one stream instead of all of them. May be repeated.\n");
+    printf("  -c <spec>  Simulate a cache of s:E:b instead of the default grid. May be repeated.\n");
+    printf("  -p <name>  Replacement policy: lru (default), fifo, random, plru, srrip or lfu. May be repeated.\n");
+    printf("  -l <name>  Tag lookup for wide sets: auto (default), avx2, sse4, neon or scalar. May be repeated.\n");
+    printf("  -W <mode>  Write policy: wb-wa (default), wb-nwa, wt-wa or wt-nwa.\n");
+    printf("  -n <num>   Accesses per stream (default %d).\n", 1 << 21);
+    printf("  -r <num>   Replays per row, the fastest is reported (default 3).\n");
+    printf("  -o <file>  Write the rows to file (CSV, or JSON for *.json) instead of stdout.\n");
+    printf("  -T <pfx>   Also write every stream as the binary trace <pfx><name>.bin.\n");
+    printf("\nStreams:\n");
+    for (g = 0; g < NUM_GENERATORS; g++) {
+        printf("  %-10s %s\n", generators[g].name, generators[g].description);
+    }
+    printf("\nExamples:\n");
+    printf("  %s -o base.csv\n", argv[0]);
+    printf("  %s -g zipf -c 10:16:6 -p lru -p srrip -l scalar -l auto\n", argv[0]);
+    exit(0);
+}
+
+static double now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+/* start a new high-water mark for peak_rss_kb(), if the kernel allows it */
+static void reset_peak_rss(void)
+{
+    FILE *f = fopen("/proc/self/clear_refs", "w");
+
+    if (f != NULL) {
+        fputs("5", f);
+        fclose(f);
+    }
+}
+
+/* VmHWM of /proc/self/status, or getrusage()'s peak where there is none */
+static long peak_rss_kb(void)
+{
+    FILE *f = fopen("/proc/self/status", "r");
+    struct rusage usage;
+    char line[256];
+    long kb = -1;
+
+    if (f != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "VmHWM: %ld", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    if (kb < 0) {
+        getrusage(RUSAGE_SELF, &usage);
+        kb = usage.ru_maxrss;
+    }
+    return kb;
+} /* end peak_rss_kb */
+
+/* feed every record to the engine the way csim's replay loop does */
+static void replay_records(cache *this_cache, cache_param_t *par, const trace_record *records, long n)
+{
+    long k;
+
+    for (k = 0; k < n; k++) {
+        switch (records[k].op) {
+        case 'L':
+            simulate_cache(this_cache, par, records[k].address);
+            break;
+        case 'S':
+            simulate_store(this_cache, par, records[k].address, records[k].size);
+            break;
+        case 'M':
+            simulate_cache(this_cache, par, records[k].address);
+            simulate_store(this_cache, par, records[k].address, records[k].size);
+            break;
+        default:
+            break;
+        }
+    }
+} /* end replay_records */
+
+/* replay the stream into cold caches of the row's geometry, keeping the fastest run */
+static void run_row(simbench_row *row, const replacement_policy *policy, int write_mode,
+                    const trace_record *records, long n, int runs)
+{
+    cache_param_t par;
+    cache this_cache;
+    double start;
+    double elapsed;
+    long k;
+    int r;
+
+    row->accesses = 0;
+    for (k = 0; k < n; k++) {
+        row->accesses += (records[k].op == 'M') ? 2 : (records[k].op == 'L' || records[k].op == 'S');
+    }
+
+    reset_peak_rss();
+    row->seconds = -1;
+    for (r = 0; r < runs; r++) {
+        bzero(&par, sizeof(par));
+        par.s = row->s;
+        par.E = row->E;
+        par.b = row->b;
+        par.S = 1 << row->s;
+        par.B = 1 << row->b;
+        this_cache = build_cache(bit_pow(par.s), par.E, bit_pow(par.b), policy);
+        set_write_policy(&this_cache, write_mode);
+
+        start = now();
+        replay_records(&this_cache, &par, records, n);
+        elapsed = now() - start;
+
+        clear_cache(this_cache, bit_pow(par.s), par.E, bit_pow(par.b));
+        if (row->seconds < 0 || elapsed < row->seconds) {
+            row->seconds = elapsed;
+        }
+    }
+    row->peak_rss_kb = peak_rss_kb();
+
+    row->hits = par.hits;
+    row->misses = par.misses;
+    row->evictions = par.evictions;
+    row->accesses_per_sec = row->seconds > 0 ? row->accesses / row->seconds : 0;
+    row->ns_per_access = row->accesses > 0 ? row->seconds * 1e9 / row->accesses : 0;
+} /* end run_row */
+
+static void write_row(FILE *out, int json, int first, const simbench_row *row)
+{
+    if (json) {
+        fprintf(out, "%s\n  {\"generator\": \"%s\", \"s\": %d, \"E\": %d, \"b\": %d, \"policy\": \"%s\", "
+                "\"lookup\": \"%s\", \"accesses\": %lld, \"hits\": %lld, \"misses\": %lld, \"evictions\": %lld, "
+                "\"seconds\": %.9f, \"accesses_per_sec\": %.0f, \"ns_per_access\": %.3f, \"peak_rss_kb\": %ld}",
+                first ? "" : ",", row->generator, row->s, row->E, row->b, row->policy, row->lookup,
+                row->accesses, row->hits, row->misses, row->evictions, row->seconds, row->accesses_per_sec,
+                row->ns_per_access, row->peak_rss_kb);
+        return;
+    }
+    fprintf(out, "%s,%d,%d,%d,%s,%s,%lld,%lld,%lld,%lld,%.9f,%.0f,%.3f,%ld\n", row->generator, row->s, row->E, row->b,
+            row->policy, row->lookup, row->accesses, row->hits, row->misses, row->evictions, row->seconds,
+            row->accesses_per_sec, row->ns_per_access, row->peak_rss_kb);
+} /* end write_row */
+
+/* write records as a delta-encoded binary trace csim -t reads */
+static int write_stream(const char *path, const trace_record *records, long n)
+{
+    FILE *f = fopen(path, "wb");
+    mem_addr_t prev_address = 0;
+    long k;
+
+    if (f == NULL) {
+        return -1;
+    }
+    write_trace_header(f, TRACE_FLAG_DELTA);
+    for (k = 0; k < n; k++) {
+        write_trace_record(f, &records[k], 1, &prev_address);
+    }
+    return fclose(f) == 0 ? 0 : -1;
+} /* end write_stream */
+
+int main(int argc, char **argv)
+{
+    const generator *chosen[MAX_GENERATORS];
+    int num_chosen = 0;
+    int geometries[MAX_GEOMETRIES][3];
+    int num_geometries = 0;
+    char *policy_names[MAX_POLICIES];
+    int num_policies = 0;
+    char *lookup_names[MAX_LOOKUPS];
+    int num_lookups = 0;
+    char *write_name = "wb-wa";
+    int write_mode;
+    long n = 1 << 21;
+    int runs = 3;
+    char *out_file = NULL;
+    FILE *out = stdout;
+    int json = 0;
+    char *trace_prefix = NULL;
+    trace_record *records;
+    int first = 1;
+    int g;
+    int k;
+    int p;
+    int l;
+
+    char c;
+    while ((c = getopt(argc, argv, "g:c:p:l:W:n:r:o:T:vh")) != -1) {
+        switch (c) {
+        case 'g':
+            for (k = 0; k < NUM_GENERATORS && strcmp(generators[k].name, optarg) != 0; k++) {
+            }
+            if (k == NUM_GENERATORS || num_chosen == MAX_GENERATORS) {
+                printf("%s: Unknown stream %s\n", argv[0], optarg);
+                exit(1);
+            }
+            chosen[num_chosen++] = &generators[k];
+            break;
+        case 'c':
+            if (num_geometries == MAX_GEOMETRIES ||
+                sscanf(optarg, "%d:%d:%d", &geometries[num_geometries][0], &geometries[num_geometries][1],
+                       &geometries[num_geometries][2]) != 3 ||
+                geometries[num_geometries][0] < 0 || geometries[num_geometries][1] < 1 ||
+                geometries[num_geometries][2] < 0) {
+                printf("%s: Invalid cache geometry %s\n", argv[0], optarg);
+                exit(1);
+            }
+            num_geometries++;
+            break;
+        case 'p':
+            if (num_policies == MAX_POLICIES || find_policy(optarg) == NULL) {
+                printf("%s: Unknown replacement policy %s\n", argv[0], optarg);
+                exit(1);
+            }
+            policy_names[num_policies++] = optarg;
+            break;
+        case 'l':
+            if (num_lookups == MAX_LOOKUPS || select_tag_lookup(optarg) == NULL) {
+                printf("%s: Tag lookup %s is not available on this machine\n", argv[0], optarg);
+                exit(1);
+            }
+            lookup_names[num_lookups++] = optarg;
+            break;
+        case 'W':
+            write_name = optarg;
+            break;
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'r':
+            runs = atoi(optarg);
+            break;
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'T':
+            trace_prefix = optarg;
+            break;
+        case 'v':
+            verbosity = 1;
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+
+    if (n < 1 || runs < 1) {
+        printf("%s: -n and -r must be positive\n", argv[0]);
+        exit(1);
+    }
+    /* the engine counts hits and misses in ints, and every record is one lookup */
+    if (n > INT_MAX) {
+        printf("%s: -n can be at most %d\n", argv[0], INT_MAX);
+        exit(1);
+    }
+    if ((write_mode = parse_write_mode(write_name)) < 0) {
+        printf("%s: Unknown write policy %s\n", argv[0], write_name);
+        exit(1);
+    }
+    if (num_chosen == 0) {
+        for (g = 0; g < NUM_GENERATORS; g++) {
+            chosen[num_chosen++] = &generators[g];
+        }
+    }
+    if (num_geometries == 0) {
+        int i;
+        int j;
+
+        for (i = 0; i < (int) (sizeof(default_s) / sizeof(default_s[0])); i++) {
+            for (j = 0; j < (int) (sizeof(default_E) / sizeof(default_E[0])); j++) {
+                for (k = 0; k < (int) (sizeof(default_b) / sizeof(default_b[0])); k++) {
+                    geometries[num_geometries][0] = default_s[i];
+                    geometries[num_geometries][1] = default_E[j];
+                    geometries[num_geometries][2] = default_b[k];
+                    num_geometries++;
+                }
+            }
+        }
+    }
+    if (num_policies == 0) {
+        policy_names[num_policies++] = "lru";
+    }
+    if (num_lookups == 0) {
+        lookup_names[num_lookups++] = "auto";
+    }
+
+    if ((records = (trace_record *) malloc(sizeof(trace_record) * n)) == NULL) {
+        printf("%s: Could not allocate %ld records\n", argv[0], n);
+        exit(1);
+    }
+    if (out_file != NULL) {
+        if ((out = fopen(out_file, "w")) == NULL) {
+            printf("%s: Could not write %s\n", argv[0], out_file);
+            exit(1);
+        }
+        json = strlen(out_file) > 5 && strcmp(out_file + strlen(out_file) - 5, ".json") == 0;
+    }
+    fprintf(out, json ? "[" : "generator,s,E,b,policy,lookup,accesses,hits,misses,evictions,"
+            "seconds,accesses_per_sec,ns_per_access,peak_rss_kb\n");
+
+    for (g = 0; g < num_chosen; g++) {
+        seed_random();
+        chosen[g]->generate(records, n);
+
+        if (trace_prefix != NULL) {
+            char path[4096];
+
+            snprintf(path, sizeof(path), "%s%s.bin", trace_prefix, chosen[g]->name);
+            if (write_stream(path, records, n) < 0) {
+                printf("%s: Could not write %s\n", argv[0], path);
+                exit(1);
+            }
+        }
+
+        for (k = 0; k < num_geometries; k++) {
+            for (p = 0; p < num_policies; p++) {
+                const replacement_policy *policy = find_policy(policy_names[p]);
+
+                if (!policy_supports(policy, geometries[k][1])) {
+                    continue;
+                }
+                for (l = 0; l < num_lookups; l++) {
+                    simbench_row row;
+
+                    bzero(&row, sizeof(row));
+                    row.generator = chosen[g]->name;
+                    row.s = geometries[k][0];
+                    row.E = geometries[k][1];
+                    row.b = geometries[k][2];
+                    row.policy = policy_names[p];
+
+                    /* narrow sets never reach tag_lookup, one row covers them */
+                    if (row.E < SIMD_MIN_WAYS) {
+                        if (l > 0) {
+                            break;
+                        }
+                        row.lookup = "-";
+                    } else {
+                        row.lookup = lookup_names[l];
+                        tag_lookup = select_tag_lookup(lookup_names[l]);
+                    }
+
+                    run_row(&row, policy, write_mode, records, n, runs);
+                    write_row(out, json, first, &row);
+                    first = 0;
+                    if (verbosity) {
+                        write_row(stderr, 0, 0, &row);
+                    }
+                }
+            }
+        }
+    }
+
+    if (json) {
+        fprintf(out, "\n]\n");
+    }
+    if (out != stdout) {
+        fclose(out);
+    }
+    free(records);
+    return 0;
+}
@@ -7,10 +7,27 @@
  * Author: Iris Yuan
  * (note on style: in trans.c and csim.c, I comment using lower-case letters for readability.)
  */ 
+#define _POSIX_C_SOURCE 200809L /* sysconf under -std=c99 */
 #include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
 #include "cachelab.h"
+#include "csim_trace.h" /* TRACE_LOAD/TRACE_STORE: plain accesses unless built with -DCSIM_TRACE */
+
+/* the simd transpose's kernels, picked at runtime like csim.c's tag lookup */
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define TRANS_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define TRANS_NEON 1
+#endif
 
 int is_transpose(int M, int N, int A[N][M], int B[M][N]);
+int is_transpose_in_place(int N, int A[N][N], int before[N][N]);
+void transpose_blocked(int M, int N, int A[N][M], int B[M][N], int tile_rows, int tile_cols, int by_column, int defer_diagonal);
+int transpose_strided(const void *src, long src_ld, void *dst, long dst_ld, int rows, int cols, int elem_size);
 
 /* 
  * transpose_submit - This is the solution transpose function that you
@@ -96,6 +113,603 @@ void transpose_submit(int M, int N, int A[N][M], int B[M][N])
 }
 
 
+/* 
+ * recursive transpose - cache-oblivious: the larger of the two dimensions
+ *     (measured in leaves) is halved until a tile is a single leaf, so at
+ *     some depth the tiles of A and B fit in any cache, whatever its size.
+ *     nothing below is tuned for one M x N.
+ */
+char transpose_recursive_desc[] = "Recursive cache-oblivious transpose";
+
+/* a leaf is 8 rows of A by 4 columns, so B gets whole 32-byte rows of 8 ints
+ * while only 4 of its lines are live; an 8x8 leaf makes B's rows collide
+ * when the stride is a power of two (64x64 misses 2.7x more). cuts are kept
+ * on whole leaves
+ */
+#define RECURSIVE_ROWS 8
+#define RECURSIVE_COLS 4
+
+/* transpose the rows x cols tile of A starting at (row, column) into B */
+static void transpose_tile(int M, int N, int A[N][M], int B[M][N], int row, int column, int rows, int cols)
+{
+	int i;
+	int j;
+	int half;
+	int temp = 0;
+
+	if (rows > RECURSIVE_ROWS || cols > RECURSIVE_COLS) {
+		/* split the side that is more leaves long, rounding the cut up to a whole leaf */
+		if (rows * RECURSIVE_COLS >= cols * RECURSIVE_ROWS) {
+			half = (rows / 2 + RECURSIVE_ROWS - 1) / RECURSIVE_ROWS * RECURSIVE_ROWS;
+			transpose_tile(M, N, A, B, row, column, half, cols);
+			transpose_tile(M, N, A, B, row + half, column, rows - half, cols);
+		} else {
+			half = (cols / 2 + RECURSIVE_COLS - 1) / RECURSIVE_COLS * RECURSIVE_COLS;
+			transpose_tile(M, N, A, B, row, column, rows, half);
+			transpose_tile(M, N, A, B, row, column + half, rows, cols - half);
+		}
+		return;
+	}
+
+	for (i = row; i < row + rows; i++) {
+		for (j = column; j < column + cols; j++) {
+			if (i != j) {
+				B[j][i] = A[i][j];
+			} else {
+				/* same as transpose_submit: B's diagonal line would evict A's row, store it last */
+				temp = A[i][j];
+			}
+		}
+		if (i >= column && i < column + cols) {
+			B[i][i] = temp;
+		}
+	}
+} /* end transpose_tile */
+
+void transpose_recursive(int M, int N, int A[N][M], int B[M][N])
+{
+	transpose_tile(M, N, A, B, 0, 0, N, M);
+}
+
+/* 
+ * blocked transpose - the family tune.c searches: A is cut into
+ *     tile_rows x tile_cols tiles, visited down each column of tiles
+ *     (by_column, like transpose_submit) or along each row of tiles.
+ *     defer_diagonal holds B[i][i] back to the end of the tile row.
+ *     its accesses go through csim_trace.h, so tune.c links this very
+ *     loop, built with -DCSIM_TRACE, and simulates it as it runs
+ */
+void transpose_blocked(int M, int N, int A[N][M], int B[M][N], int tile_rows, int tile_cols, int by_column, int defer_diagonal)
+{
+	int row_tiles = (N + tile_rows - 1) / tile_rows;
+	int col_tiles = (M + tile_cols - 1) / tile_cols;
+	int t;
+	int i;
+	int j;
+	int row;
+	int column;
+	int temp = 0;
+
+	for (t = 0; t < row_tiles * col_tiles; t++) {
+		if (by_column) {
+			column = t / row_tiles * tile_cols;
+			row = t % row_tiles * tile_rows;
+		} else {
+			row = t / col_tiles * tile_rows;
+			column = t % col_tiles * tile_cols;
+		}
+		for (i = row; i < row + tile_rows && i < N; i++) {
+			for (j = column; j < column + tile_cols && j < M; j++) {
+				if (i != j || !defer_diagonal) {
+					TRACE_STORE(B[j][i], TRACE_LOAD(A[i][j]));
+				} else {
+					temp = TRACE_LOAD(A[i][j]);
+				}
+			}
+			if (defer_diagonal && i >= column && i < column + tile_cols && i < M) {
+				TRACE_STORE(B[i][i], temp);
+			}
+		}
+	}
+} /* end transpose_blocked */
+
+/* 
+ * swap transpose - 8x8 blocks moved in 4x4 quadrants, for M and N that are
+ *     multiples of 8 (the 64x64 case above settles for 4x4 tiles). with a
+ *     power-of-two stride B's rows 4 apart share a set, so only the top 4
+ *     rows of a B block can be live at once. A's rows are still read 8 ints
+ *     at a time: A's top-right quadrant is parked in B's top-right quadrant,
+ *     then swapped down into place while the bottom-left quadrant is read
+ */
+char transpose_swap_desc[] = "8x8 blocks with 4x4 sub-block swap";
+
+void transpose_swap(int M, int N, int A[N][M], int B[M][N])
+{
+	int i;
+	int j;
+	int k;
+	int a0, a1, a2, a3, a4, a5, a6, a7; /* one 32-byte line, 11 variables in all */
+
+	if (M % 8 != 0 || N % 8 != 0) {
+		transpose_recursive(M, N, A, B);
+		return;
+	}
+
+	for (i = 0; i < N; i += 8) {
+		for (j = 0; j < M; j += 8) {
+			/* top half of A's block: the left quadrant into place, the right one parked next to it */
+			for (k = i; k < i + 4; k++) {
+				a0 = A[k][j]; a1 = A[k][j + 1]; a2 = A[k][j + 2]; a3 = A[k][j + 3];
+				a4 = A[k][j + 4]; a5 = A[k][j + 5]; a6 = A[k][j + 6]; a7 = A[k][j + 7];
+				B[j][k] = a0; B[j + 1][k] = a1; B[j + 2][k] = a2; B[j + 3][k] = a3;
+				B[j][k + 4] = a4; B[j + 1][k + 4] = a5; B[j + 2][k + 4] = a6; B[j + 3][k + 4] = a7;
+			}
+			/* take each parked row back, replace it with a column of A's bottom-left quadrant,
+			 * and store it in the bottom half of B's block
+			 */
+			for (k = j; k < j + 4; k++) {
+				a0 = B[k][i + 4]; a1 = B[k][i + 5]; a2 = B[k][i + 6]; a3 = B[k][i + 7];
+				a4 = A[i + 4][k]; a5 = A[i + 5][k]; a6 = A[i + 6][k]; a7 = A[i + 7][k];
+				B[k][i + 4] = a4; B[k][i + 5] = a5; B[k][i + 6] = a6; B[k][i + 7] = a7;
+				B[k + 4][i] = a0; B[k + 4][i + 1] = a1; B[k + 4][i + 2] = a2; B[k + 4][i + 3] = a3;
+			}
+			/* bottom-right quadrant, B's bottom rows are already live */
+			for (k = i + 4; k < i + 8; k++) {
+				a0 = A[k][j + 4]; a1 = A[k][j + 5]; a2 = A[k][j + 6]; a3 = A[k][j + 7];
+				B[j + 4][k] = a0; B[j + 5][k] = a1; B[j + 6][k] = a2; B[j + 7][k] = a3;
+			}
+		}
+	}
+} /* end transpose_swap */
+
+/* 
+ * simd transpose - the same walk as transpose_submit, but every full tile
+ *     is loaded into registers a row at a time and transposed there with
+ *     unpack/shuffle instructions: 8x8 with AVX2, else 4x4 with SSE2 or
+ *     NEON. A's and B's tiles are never live together, so there is no
+ *     diagonal to work around. the partial tiles at the right and bottom
+ *     edges (61x67) go through the scalar recursive transpose
+ */
+char transpose_simd_desc[] = "SIMD register-blocked transpose";
+
+#ifdef TRANS_X86
+/* 8x8 ints: three rounds of unpacks within 128-bit lanes, then one across them.
+ * each round writes back into the rows it read, so t is the only spare
+ */
+__attribute__((target("avx2")))
+static void transpose_8x8_avx2(const int *src, int src_stride, int *dst, int dst_stride)
+{
+	__m256i r0 = _mm256_loadu_si256((const __m256i *) (src + 0 * src_stride));
+	__m256i r1 = _mm256_loadu_si256((const __m256i *) (src + 1 * src_stride));
+	__m256i r2 = _mm256_loadu_si256((const __m256i *) (src + 2 * src_stride));
+	__m256i r3 = _mm256_loadu_si256((const __m256i *) (src + 3 * src_stride));
+	__m256i r4 = _mm256_loadu_si256((const __m256i *) (src + 4 * src_stride));
+	__m256i r5 = _mm256_loadu_si256((const __m256i *) (src + 5 * src_stride));
+	__m256i r6 = _mm256_loadu_si256((const __m256i *) (src + 6 * src_stride));
+	__m256i r7 = _mm256_loadu_si256((const __m256i *) (src + 7 * src_stride));
+	__m256i t;
+
+	/* interleave pairs of rows: r0 = a0 b0 a1 b1 | a4 b4 a5 b5, r1 = a2 b2 a3 b3 | ... */
+	t = _mm256_unpacklo_epi32(r0, r1); r1 = _mm256_unpackhi_epi32(r0, r1); r0 = t;
+	t = _mm256_unpacklo_epi32(r2, r3); r3 = _mm256_unpackhi_epi32(r2, r3); r2 = t;
+	t = _mm256_unpacklo_epi32(r4, r5); r5 = _mm256_unpackhi_epi32(r4, r5); r4 = t;
+	t = _mm256_unpacklo_epi32(r6, r7); r7 = _mm256_unpackhi_epi32(r6, r7); r6 = t;
+
+	/* then pairs of pairs: r0 = a0 b0 c0 d0 | a4 b4 c4 d4, r2 = column 1, r1 = 2, r3 = 3 */
+	t = _mm256_unpacklo_epi64(r0, r2); r2 = _mm256_unpackhi_epi64(r0, r2); r0 = t;
+	t = _mm256_unpacklo_epi64(r1, r3); r3 = _mm256_unpackhi_epi64(r1, r3); r1 = t;
+	t = _mm256_unpacklo_epi64(r4, r6); r6 = _mm256_unpackhi_epi64(r4, r6); r4 = t;
+	t = _mm256_unpacklo_epi64(r5, r7); r7 = _mm256_unpackhi_epi64(r5, r7); r5 = t;
+
+	/* the low lanes hold columns 0-3, the high lanes columns 4-7 */
+	_mm256_storeu_si256((__m256i *) (dst + 0 * dst_stride), _mm256_permute2x128_si256(r0, r4, 0x20));
+	_mm256_storeu_si256((__m256i *) (dst + 1 * dst_stride), _mm256_permute2x128_si256(r2, r6, 0x20));
+	_mm256_storeu_si256((__m256i *) (dst + 2 * dst_stride), _mm256_permute2x128_si256(r1, r5, 0x20));
+	_mm256_storeu_si256((__m256i *) (dst + 3 * dst_stride), _mm256_permute2x128_si256(r3, r7, 0x20));
+	_mm256_storeu_si256((__m256i *) (dst + 4 * dst_stride), _mm256_permute2x128_si256(r0, r4, 0x31));
+	_mm256_storeu_si256((__m256i *) (dst + 5 * dst_stride), _mm256_permute2x128_si256(r2, r6, 0x31));
+	_mm256_storeu_si256((__m256i *) (dst + 6 * dst_stride), _mm256_permute2x128_si256(r1, r5, 0x31));
+	_mm256_storeu_si256((__m256i *) (dst + 7 * dst_stride), _mm256_permute2x128_si256(r3, r7, 0x31));
+} /* end transpose_8x8_avx2 */
+
+/* 4x4 ints with SSE2, which every x86-64 has */
+__attribute__((target("sse2")))
+static void transpose_4x4_simd(const int *src, int src_stride, int *dst, int dst_stride)
+{
+	__m128i r0 = _mm_loadu_si128((const __m128i *) (src + 0 * src_stride));
+	__m128i r1 = _mm_loadu_si128((const __m128i *) (src + 1 * src_stride));
+	__m128i r2 = _mm_loadu_si128((const __m128i *) (src + 2 * src_stride));
+	__m128i r3 = _mm_loadu_si128((const __m128i *) (src + 3 * src_stride));
+	__m128i t;
+
+	/* r0 = a0 b0 a1 b1, r1 = a2 b2 a3 b3, r2 = c0 d0 c1 d1, r3 = c2 d2 c3 d3 */
+	t = _mm_unpacklo_epi32(r0, r1); r1 = _mm_unpackhi_epi32(r0, r1); r0 = t;
+	t = _mm_unpacklo_epi32(r2, r3); r3 = _mm_unpackhi_epi32(r2, r3); r2 = t;
+
+	_mm_storeu_si128((__m128i *) (dst + 0 * dst_stride), _mm_unpacklo_epi64(r0, r2));
+	_mm_storeu_si128((__m128i *) (dst + 1 * dst_stride), _mm_unpackhi_epi64(r0, r2));
+	_mm_storeu_si128((__m128i *) (dst + 2 * dst_stride), _mm_unpacklo_epi64(r1, r3));
+	_mm_storeu_si128((__m128i *) (dst + 3 * dst_stride), _mm_unpackhi_epi64(r1, r3));
+} /* end transpose_4x4_simd */
+#endif
+
+#ifdef TRANS_NEON
+/* 4x4 ints: trn pairs up rows, then the 64-bit halves are recombined */
+static void transpose_4x4_simd(const int *src, int src_stride, int *dst, int dst_stride)
+{
+	int32x4x2_t p = vtrnq_s32(vld1q_s32(src + 0 * src_stride), vld1q_s32(src + 1 * src_stride));
+	int32x4x2_t q = vtrnq_s32(vld1q_s32(src + 2 * src_stride), vld1q_s32(src + 3 * src_stride));
+
+	/* p.val[0] = a0 b0 a2 b2, p.val[1] = a1 b1 a3 b3, q likewise for c and d */
+	vst1q_s32(dst + 0 * dst_stride, vcombine_s32(vget_low_s32(p.val[0]), vget_low_s32(q.val[0])));
+	vst1q_s32(dst + 1 * dst_stride, vcombine_s32(vget_low_s32(p.val[1]), vget_low_s32(q.val[1])));
+	vst1q_s32(dst + 2 * dst_stride, vcombine_s32(vget_high_s32(p.val[0]), vget_high_s32(q.val[0])));
+	vst1q_s32(dst + 3 * dst_stride, vcombine_s32(vget_high_s32(p.val[1]), vget_high_s32(q.val[1])));
+} /* end transpose_4x4_simd */
+#endif
+
+/* the widest kernel this cpu runs: 8, 4, or 0 when there is none */
+static int simd_tile(void)
+{
+#ifdef TRANS_X86
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		return 8;
+	}
+	return __builtin_cpu_supports("sse2") ? 4 : 0;
+#elif defined(TRANS_NEON)
+	return 4;
+#else
+	return 0;
+#endif
+}
+
+/* transpose A's columns column .. column + cols - 1, all N rows of them */
+static void transpose_simd_columns(int M, int N, int A[N][M], int B[M][N], int column, int cols, int tile)
+{
+	int i;
+	int j;
+	int rows = N / tile * tile;
+	int full = column + cols / tile * tile; /* end of the full tiles */
+
+	/* the full tiles, down each column of tiles */
+	for (j = column; j < full; j += tile) {
+		for (i = 0; i < rows; i += tile) {
+#ifdef TRANS_X86
+			if (tile == 8) {
+				transpose_8x8_avx2(&A[i][j], M, &B[j][i], N);
+				continue;
+			}
+#endif
+#if defined(TRANS_X86) || defined(TRANS_NEON)
+			transpose_4x4_simd(&A[i][j], M, &B[j][i], N);
+#endif
+		}
+	}
+
+	/* the edges: columns past the last full tile, then rows past it */
+	if (full < column + cols) {
+		transpose_tile(M, N, A, B, 0, full, N, column + cols - full);
+	}
+	if (rows < N && full > column) {
+		transpose_tile(M, N, A, B, rows, column, N - rows, full - column);
+	}
+} /* end transpose_simd_columns */
+
+void transpose_simd(int M, int N, int A[N][M], int B[M][N])
+{
+	int tile = simd_tile();
+
+	if (tile == 0) {
+		transpose_recursive(M, N, A, B);
+		return;
+	}
+	transpose_simd_columns(M, N, A, B, 0, M, tile);
+} /* end transpose_simd */
+
+/* 
+ * parallel transpose - for matrices past a few MB. A's columns, which are
+ *     B's rows, are cut into bands of PARALLEL_BAND and each thread gets one
+ *     contiguous run of bands, transposed with the simd kernels. a band
+ *     starts a multiple of 16 rows into B, which is 64*N bytes from
+ *     &B[0][0] whatever N is, so if B starts on a 64-byte line every line
+ *     of B is written by one thread only. malloc only promises 16 bytes:
+ *     allocate B with posix_memalign(..., 64, ...) for that, otherwise the
+ *     one line straddling each boundary between two threads' shares is
+ *     written by both (one line per thread per call). the split is
+ *     static, so a B nobody has touched yet gets its pages placed by first
+ *     touch on the node of the thread that writes them, and keeps them run
+ *     after run.
+ *     like the simd kernels this is for real hardware, not the lab's
+ *     grader: it uses an array of thread handles and pthreads.
+ *     TRANS_THREADS in the environment overrides the thread count, which
+ *     defaults to the number of online cpus
+ */
+char transpose_parallel_desc[] = "Multithreaded tiled transpose";
+
+#define PARALLEL_BAND 16         /* B rows per band: 64*N bytes, whole lines if B is line-aligned */
+#define PARALLEL_MAX_THREADS 64
+#define PARALLEL_MIN_BYTES (1 << 20) /* smaller matrices aren't worth a thread */
+
+/* one thread's share of a transpose_parallel call */
+typedef struct {
+	int M;
+	int N;
+	int *A;
+	int *B;
+	int column;  /* first of A's columns */
+	int cols;
+	int tile;
+	pthread_t thread;
+} parallel_job;
+
+static void *parallel_main(void *arg)
+{
+	parallel_job *job = (parallel_job *) arg;
+	int (*A)[job->M] = (int (*)[job->M]) job->A;
+	int (*B)[job->N] = (int (*)[job->N]) job->B;
+
+	if (job->tile == 0) {
+		transpose_tile(job->M, job->N, A, B, 0, job->column, job->N, job->cols);
+	} else {
+		transpose_simd_columns(job->M, job->N, A, B, job->column, job->cols, job->tile);
+	}
+	return NULL;
+}
+
+/* how many threads to run: TRANS_THREADS, else one per online cpu */
+static int parallel_threads(void)
+{
+	const char *env = getenv("TRANS_THREADS");
+	long threads = env != NULL ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);
+
+	if (threads < 1) {
+		return 1;
+	}
+	return threads > PARALLEL_MAX_THREADS ? PARALLEL_MAX_THREADS : (int) threads;
+}
+
+void transpose_parallel(int M, int N, int A[N][M], int B[M][N])
+{
+	parallel_job jobs[PARALLEL_MAX_THREADS];
+	int bands = (M + PARALLEL_BAND - 1) / PARALLEL_BAND;
+	int threads = parallel_threads();
+	int started;
+	int k;
+
+	if (threads > bands) {
+		threads = bands;
+	}
+	if (threads == 1 || (long) M * N * sizeof(int) < PARALLEL_MIN_BYTES) {
+		transpose_simd(M, N, A, B);
+		return;
+	}
+
+	for (k = 0; k < threads; k++) {
+		jobs[k].M = M;
+		jobs[k].N = N;
+		jobs[k].A = &A[0][0];
+		jobs[k].B = &B[0][0];
+		jobs[k].column = (int) ((long) bands * k / threads) * PARALLEL_BAND;
+		jobs[k].cols = (int) ((long) bands * (k + 1) / threads) * PARALLEL_BAND - jobs[k].column;
+		if (jobs[k].column + jobs[k].cols > M) {
+			jobs[k].cols = M - jobs[k].column;
+		}
+		jobs[k].tile = simd_tile();
+	}
+
+	/* the calling thread takes the first share; if a thread can't be started its share runs here too */
+	for (started = 1; started < threads; started++) {
+		if (pthread_create(&jobs[started].thread, NULL, parallel_main, &jobs[started]) != 0) {
+			break;
+		}
+	}
+	parallel_main(&jobs[0]);
+	for (k = started; k < threads; k++) {
+		parallel_main(&jobs[k]);
+	}
+	for (k = 1; k < started; k++) {
+		pthread_join(jobs[k].thread, NULL);
+	}
+} /* end transpose_parallel */
+
+/* 
+ * in-place transpose - square matrices only, with no B: tiles on either
+ *     side of the diagonal are swapped in pairs, and the diagonal tiles are
+ *     transposed within themselves. for a full pair off the diagonal
+ *     (swap_tiles_8), like transpose_submit's diagonal temp, a whole row of
+ *     one tile is read into registers before the other tile's column
+ *     overwrites it, so the two never evict each other mid-row. diagonal
+ *     tiles and the ragged ones at the edges are swapped one element at a
+ *     time (swap_tiles). the registered wrapper copies A into B a line at a
+ *     time and transposes B in place, so the driver can check and count
+ *     it; call transpose_square_in_place() directly to save the second
+ *     matrix
+ */
+char transpose_in_place_desc[] = "In-place square transpose (of a copy in B)";
+
+#define IN_PLACE_TILE 8
+
+/* swap the full tile at (row, column) with the one mirrored across the
+ * diagonal, transposing both: one row of the first against one column of
+ * the second at a time
+ */
+static void swap_tiles_8(int N, int A[N][N], int row, int column)
+{
+	int i;
+	int a0, a1, a2, a3, a4, a5, a6, a7;
+
+	for (i = row; i < row + 8; i++) {
+		a0 = A[i][column]; a1 = A[i][column + 1]; a2 = A[i][column + 2]; a3 = A[i][column + 3];
+		a4 = A[i][column + 4]; a5 = A[i][column + 5]; a6 = A[i][column + 6]; a7 = A[i][column + 7];
+		A[i][column] = A[column][i]; A[i][column + 1] = A[column + 1][i];
+		A[i][column + 2] = A[column + 2][i]; A[i][column + 3] = A[column + 3][i];
+		A[i][column + 4] = A[column + 4][i]; A[i][column + 5] = A[column + 5][i];
+		A[i][column + 6] = A[column + 6][i]; A[i][column + 7] = A[column + 7][i];
+		A[column][i] = a0; A[column + 1][i] = a1; A[column + 2][i] = a2; A[column + 3][i] = a3;
+		A[column + 4][i] = a4; A[column + 5][i] = a5; A[column + 6][i] = a6; A[column + 7][i] = a7;
+	}
+} /* end swap_tiles_8 */
+
+/* the same for a rows x cols tile at the edges, and for the diagonal tiles,
+ * where only the elements past the diagonal are swapped
+ */
+static void swap_tiles(int N, int A[N][N], int row, int column, int rows, int cols)
+{
+	int i;
+	int j;
+	int temp;
+
+	for (i = row; i < row + rows; i++) {
+		for (j = (row == column) ? i + 1 : column; j < column + cols; j++) {
+			temp = A[i][j];
+			A[i][j] = A[j][i];
+			A[j][i] = temp;
+		}
+	}
+} /* end swap_tiles */
+
+void transpose_square_in_place(int N, int A[N][N])
+{
+	int row;
+	int column;
+	int size;
+
+	for (row = 0; row < N; row += IN_PLACE_TILE) {
+		size = (N - row < IN_PLACE_TILE) ? N - row : IN_PLACE_TILE;
+		swap_tiles(N, A, row, row, size, size);
+		for (column = row + IN_PLACE_TILE; column < N; column += IN_PLACE_TILE) {
+			if (N - column >= IN_PLACE_TILE && size == IN_PLACE_TILE) {
+				swap_tiles_8(N, A, row, column);
+			} else {
+				swap_tiles(N, A, row, column, size, (N - column < IN_PLACE_TILE) ? N - column : IN_PLACE_TILE);
+			}
+		}
+	}
+} /* end transpose_square_in_place */
+
+void transpose_in_place(int M, int N, int A[N][M], int B[M][N])
+{
+	int i;
+	int j;
+	int a0, a1, a2, a3, a4, a5, a6, a7;
+
+	if (M != N) {
+		transpose_recursive(M, N, A, B);
+		return;
+	}
+	/* A and B map to the same sets, so copy a whole line of A into
+	 * registers before its B line evicts it: 2 misses per line
+	 */
+	for (i = 0; i < N; i++) {
+		for (j = 0; j + 8 <= N; j += 8) {
+			a0 = A[i][j]; a1 = A[i][j + 1]; a2 = A[i][j + 2]; a3 = A[i][j + 3];
+			a4 = A[i][j + 4]; a5 = A[i][j + 5]; a6 = A[i][j + 6]; a7 = A[i][j + 7];
+			B[i][j] = a0; B[i][j + 1] = a1; B[i][j + 2] = a2; B[i][j + 3] = a3;
+			B[i][j + 4] = a4; B[i][j + 5] = a5; B[i][j + 6] = a6; B[i][j + 7] = a7;
+		}
+		for (; j < N; j++) {
+			B[i][j] = A[i][j];
+		}
+	}
+	transpose_square_in_place(N, B);
+} /* end transpose_in_place */
+
+/* 
+ * strided transpose - any element width of 1, 2, 4 or 8 bytes, and
+ *     sub-views: src is rows x cols with src_ld elements from one row to
+ *     the next, dst gets cols x rows with dst_ld elements per row (each ld
+ *     at least the row it holds). the kernel for each width is stamped out
+ *     by DEFINE_STRIDED_TRANSPOSE, so the tile side is a constant the
+ *     compiler unrolls: GENERIC_LINE_BYTES / width elements, which keeps a
+ *     tile row one whole 32-byte line whatever the type (32x32 bytes, 16x16
+ *     halves, the usual 8x8 ints, 4x4 doubles)
+ */
+char transpose_strided_desc[] = "Type-generic strided transpose (ints)";
+
+#define GENERIC_LINE_BYTES 32
+
+#define DEFINE_STRIDED_TRANSPOSE(name, type) \
+static void name(const type *src, long src_ld, type *dst, long dst_ld, int rows, int cols) \
+{ \
+	int tile = GENERIC_LINE_BYTES / sizeof(type); \
+	int row; \
+	int column; \
+	int i; \
+	int j; \
+\
+	for (column = 0; column < cols; column += tile) { \
+		for (row = 0; row < rows; row += tile) { \
+			if (row + tile <= rows && column + tile <= cols) { \
+				/* full tile: constant trip counts */ \
+				for (i = row; i < row + tile; i++) { \
+					for (j = column; j < column + tile; j++) { \
+						dst[j * dst_ld + i] = src[i * src_ld + j]; \
+					} \
+				} \
+			} else { \
+				for (i = row; i < row + tile && i < rows; i++) { \
+					for (j = column; j < column + tile && j < cols; j++) { \
+						dst[j * dst_ld + i] = src[i * src_ld + j]; \
+					} \
+				} \
+			} \
+		} \
+	} \
+}
+
+DEFINE_STRIDED_TRANSPOSE(transpose_strided_8, unsigned char)
+DEFINE_STRIDED_TRANSPOSE(transpose_strided_16, unsigned short)
+DEFINE_STRIDED_TRANSPOSE(transpose_strided_32, unsigned int)
+DEFINE_STRIDED_TRANSPOSE(transpose_strided_64, unsigned long long)
+
+/* returns -1 for an element width without a kernel or a leading dimension
+ * shorter than its rows
+ */
+int transpose_strided(const void *src, long src_ld, void *dst, long dst_ld, int rows, int cols, int elem_size)
+{
+	if (src_ld < cols || dst_ld < rows) {
+		return -1;
+	}
+	switch (elem_size) {
+	case 1:
+		transpose_strided_8((const unsigned char *) src, src_ld, (unsigned char *) dst, dst_ld, rows, cols);
+		return 0;
+	case 2:
+		transpose_strided_16((const unsigned short *) src, src_ld, (unsigned short *) dst, dst_ld, rows, cols);
+		return 0;
+	case 4:
+		transpose_strided_32((const unsigned int *) src, src_ld, (unsigned int *) dst, dst_ld, rows, cols);
+		return 0;
+	case 8:
+		transpose_strided_64((const unsigned long long *) src, src_ld, (unsigned long long *) dst, dst_ld, rows, cols);
+		return 0;
+	}
+	return -1;
+} /* end transpose_strided */
+
+/* the int case, dense, so the driver can count it */
+void transpose_strided_int(int M, int N, int A[N][M], int B[M][N])
+{
+	transpose_strided(&A[0][0], M, &B[0][0], N, N, M, sizeof(int));
+}
+
+/* the best blocked transpose per shape, written by tune.c for the lab's cache */
+#include "trans_tuned.h"
+
+/* 
+ * tuned transpose - the table from tune.c for the shapes it was run on,
+ *     the recursive transpose for every other one
+ */
+char transpose_tuned_desc[] = "Auto-tuned blocked transpose";
+
+void transpose_tuned(int M, int N, int A[N][M], int B[M][N])
+{
+	if (!transpose_tuned_shape(M, N, A, B)) {
+		transpose_recursive(M, N, A, B);
+	}
+}
+
 /*
  * registerFunctions - This function registers your transpose
  *     functions with the driver.  At runtime, the driver will
@@ -109,6 +723,13 @@ void registerFunctions()
     registerTransFunction(transpose_submit, transpose_submit_desc); 
 
     /* Register any additional transpose functions */
+    registerTransFunction(transpose_recursive, transpose_recursive_desc); 
+    registerTransFunction(transpose_tuned, transpose_tuned_desc); 
+    registerTransFunction(transpose_swap, transpose_swap_desc); 
+    registerTransFunction(transpose_simd, transpose_simd_desc); 
+    registerTransFunction(transpose_parallel, transpose_parallel_desc); 
+    registerTransFunction(transpose_in_place, transpose_in_place_desc); 
+    registerTransFunction(transpose_strided_int, transpose_strided_desc); 
 
 }
 
@@ -130,3 +751,22 @@ int is_transpose(int M, int N, int A[N][M], int B[M][N])
     }
     return 1;
 }
+
+/* 
+ * is_transpose_in_place - the check for transpose_square_in_place(): A
+ *     after the transpose, before a copy of A taken ahead of it. besides
+ *     every pair across the diagonal, the diagonal itself must be untouched
+ */
+int is_transpose_in_place(int N, int A[N][N], int before[N][N])
+{
+    int i, j;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < N; j++) {
+            if (A[i][j] != before[j][i]) {
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,25 @@
+/*
+ * trans_tuned.h - generated by tune.c, do not edit. regenerate with:
+ *     ./tune -s 5 -E 1 -b 5 -n 32x32 -n 64x64 -n 61x67 -o trans_tuned.h
+ *
+ * the blocked transpose that missed least on a 32-set, 1-way cache
+ * with 32-byte blocks, for every tuned shape
+ */
+
+/* returns 0 if M x N wasn't tuned */
+static int transpose_tuned_shape(int M, int N, int A[N][M], int B[M][N])
+{
+	if (M == 32 && N == 32) { /* 284 misses */
+		transpose_blocked(M, N, A, B, 1, 8, 1, 1);
+		return 1;
+	}
+	if (M == 64 && N == 64) { /* 1744 misses */
+		transpose_blocked(M, N, A, B, 1, 4, 1, 1);
+		return 1;
+	}
+	if (M == 61 && N == 67) { /* 1803 misses */
+		transpose_blocked(M, N, A, B, 1, 17, 1, 1);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,269 @@
+/*
+ * tune.c - searches blocked transposes against the csim engine and writes
+ *     the best one per matrix shape as trans_tuned.h, which trans.c's
+ *     transpose_tuned() dispatches on.
+ *
+ * every candidate is a call of trans.c's transpose_blocked(): tile_rows x
+ * tile_cols tiles of A (1..TUNE_MAX_TILE each), walked down the columns of
+ * tiles or along the rows of tiles, with or without the diagonal store
+ * deferred to the end of the tile row. trans.c is built with -DCSIM_TRACE,
+ * so the kernel's own accesses go to csim's engine as it moves the data
+ * (csim_trace.h), and no trace is ever written. A and B sit where the
+ * lab's tracegen puts them: two int[256][256] back to back.
+ *
+ * build:  gcc -O2 -std=c99 -DCSIM_NO_MAIN -DCSIM_TRACE -o tune tune.c trans.c csim.c cachelab.c -lm -lpthread
+ * run:    ./tune -s 5 -E 1 -b 5 -n 32x32 -n 64x64 -n 61x67 -o trans_tuned.h
+ *
+ * Author: Iris Yuan
+ */
+#include <stdlib.h>
+#include <stdio.h>
+#include <getopt.h>
+#include <string.h>
+#include <strings.h>
+#include "cachelab.h"
+#include "csim.h"
+#include "csim_trace.h"
+
+/* from trans.c */
+void transpose_blocked(int M, int N, int A[N][M], int B[M][N], int tile_rows, int tile_cols, int by_column, int defer_diagonal);
+
+/* tracegen's matrices, so shapes are capped like the driver caps them */
+#define TUNE_MAX_DIM 256
+#define TUNE_MAX_TILE 32
+#define TUNE_MAX_SHAPES 64
+
+/* one candidate transpose, as transpose_blocked() takes it */
+typedef struct {
+    int tile_rows;
+    int tile_cols;
+    int by_column;       /* walk down each column of tiles */
+    int defer_diagonal;  /* store B[i][i] last in its tile row */
+    int misses;          /* result of replaying it */
+    int hits;
+    int evictions;
+    int order;           /* position in the enumeration, breaks ties */
+} candidate;
+
+typedef struct {
+    int M;
+    int N;
+} matrix_shape;
+
+/* A, then B; accesses are simulated at their offset from A */
+static int matrices[2 * TUNE_MAX_DIM * TUNE_MAX_DIM];
+#define MATRIX_A matrices
+#define MATRIX_B (matrices + TUNE_MAX_DIM * TUNE_MAX_DIM)
+
+/* the geometry being tuned for */
+static cache_param_t tune_par;
+
+/*
+ * printUsage - Print usage info
+ */
+static void printUsage(char* argv[])
+{
+    printf("Usage: %s [-hv] -s <num> -E <num> -b <num> -n <MxN> [-n <MxN> ...] [-o <file>]\n", argv[0]);
+    printf("Options:\n");
+    printf("  -h         Print this help message.\n");
+    printf("  -v         Print the five best candidates of every shape.\n");
+    printf("  -s <num>   Number of set index bits.\n");
+    printf("  -E <num>   Number of lines per set.\n");
+    printf("  -b <num>   Number of block offset bits.\n");
+    printf("  -p <name>  Replacement policy: lru (default), fifo, random, plru, srrip or lfu.\n");
+    printf("  -n <MxN>   Tune an M-column, N-row A (at most %d each). May be repeated.\n", TUNE_MAX_DIM);
+    printf("  -o <file>  Write the dispatch table to file instead of stdout.\n");
+    printf("\nExamples:\n");
+    printf("  %s -s 5 -E 1 -b 5 -n 32x32 -n 64x64 -n 61x67 -o trans_tuned.h\n", argv[0]);
+    exit(0);
+}
+
+/* replay cand on a cold cache and record its counters. returns -1 if B
+ * doesn't come out as the transpose of A
+ */
+static int run_candidate(int M, int N, const replacement_policy *policy, candidate *cand)
+{
+    cache_param_t counts;
+    int i;
+    int j;
+
+    for (i = 0; i < M * N; i++) {
+        MATRIX_A[i] = i;
+        MATRIX_B[i] = -1;
+    }
+
+    csim_trace_begin(tune_par.s, tune_par.E, tune_par.b, policy, 0, matrices);
+    transpose_blocked(M, N, (int (*)[M]) MATRIX_A, (int (*)[N]) MATRIX_B, cand->tile_rows, cand->tile_cols,
+                      cand->by_column, cand->defer_diagonal);
+    csim_trace_end(&counts);
+
+    cand->hits = counts.hits;
+    cand->misses = counts.misses;
+    cand->evictions = counts.evictions;
+
+    for (i = 0; i < N; i++) {
+        for (j = 0; j < M; j++) {
+            if (MATRIX_B[j * N + i] != MATRIX_A[i * M + j]) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+} /* end run_candidate */
+
+/* qsort order: fewest misses first, then the order they were enumerated in */
+static int compare_candidates(const void *a, const void *b)
+{
+    const candidate *x = (const candidate *) a;
+    const candidate *y = (const candidate *) b;
+
+    if (x->misses != y->misses) {
+        return x->misses < y->misses ? -1 : 1;
+    }
+    return x->order - y->order;
+}
+
+/* try every candidate on one shape and leave the best in *best */
+static int tune_shape(int M, int N, const replacement_policy *policy, candidate *best)
+{
+    int num_cands = TUNE_MAX_TILE * TUNE_MAX_TILE * 4;
+    candidate *cands = (candidate *) malloc(sizeof(candidate) * num_cands);
+    int k = 0;
+    int rows;
+    int cols;
+    int flags;
+
+    for (rows = 1; rows <= TUNE_MAX_TILE; rows++) {
+        for (cols = 1; cols <= TUNE_MAX_TILE; cols++) {
+            for (flags = 0; flags < 4; flags++) {
+                cands[k].tile_rows = rows;
+                cands[k].tile_cols = cols;
+                cands[k].by_column = (flags & 1) != 0;
+                cands[k].defer_diagonal = (flags & 2) != 0;
+                cands[k].order = k;
+                if (run_candidate(M, N, policy, &cands[k]) < 0) {
+                    free(cands);
+                    return -1;
+                }
+                k++;
+            }
+        }
+    }
+
+    qsort(cands, num_cands, sizeof(candidate), compare_candidates);
+    *best = cands[0];
+
+    if (verbosity) {
+        for (k = 0; k < 5; k++) {
+            fprintf(stderr, "%dx%d: %dx%d tiles%s%s misses:%d\n", M, N, cands[k].tile_rows, cands[k].tile_cols,
+                    cands[k].by_column ? " by column" : " by row",
+                    cands[k].defer_diagonal ? ", diagonal deferred" : "", cands[k].misses);
+        }
+    }
+    free(cands);
+    return 0;
+} /* end tune_shape */
+
+/* write the dispatch function trans.c includes */
+static void write_table(FILE *out, int argc, char **argv, const matrix_shape *shapes,
+                        const candidate *best, int num_shapes)
+{
+    int k;
+
+    fprintf(out, "/*\n * trans_tuned.h - generated by tune.c, do not edit. regenerate with:\n *    ");
+    for (k = 0; k < argc; k++) {
+        fprintf(out, " %s", argv[k]);
+    }
+    fprintf(out, "\n *\n * the blocked transpose that missed least on a %d-set, %d-way cache\n"
+            " * with %d-byte blocks, for every tuned shape\n */\n\n",
+            1 << tune_par.s, tune_par.E, 1 << tune_par.b);
+    fprintf(out, "/* returns 0 if M x N wasn't tuned */\n");
+    fprintf(out, "static int transpose_tuned_shape(int M, int N, int A[N][M], int B[M][N])\n{\n");
+    for (k = 0; k < num_shapes; k++) {
+        fprintf(out, "\tif (M == %d && N == %d) { /* %d misses */\n", shapes[k].M, shapes[k].N, best[k].misses);
+        fprintf(out, "\t\ttranspose_blocked(M, N, A, B, %d, %d, %d, %d);\n",
+                best[k].tile_rows, best[k].tile_cols, best[k].by_column, best[k].defer_diagonal);
+        fprintf(out, "\t\treturn 1;\n\t}\n");
+    }
+    fprintf(out, "\treturn 0;\n}\n");
+} /* end write_table */
+
+int main(int argc, char **argv)
+{
+    matrix_shape shapes[TUNE_MAX_SHAPES];
+    candidate best[TUNE_MAX_SHAPES];
+    int num_shapes = 0;
+    char *policy_name = "lru";
+    const replacement_policy *policy;
+    char *out_file = NULL;
+    FILE *out = stdout;
+    int k;
+
+    char c;
+    bzero(&tune_par, sizeof(tune_par));
+    while ((c = getopt(argc, argv, "s:E:b:p:n:o:vh")) != -1) {
+        switch (c) {
+        case 's':
+            tune_par.s = atoi(optarg);
+            break;
+        case 'E':
+            tune_par.E = atoi(optarg);
+            break;
+        case 'b':
+            tune_par.b = atoi(optarg);
+            break;
+        case 'p':
+            policy_name = optarg;
+            break;
+        case 'n':
+            if (num_shapes == TUNE_MAX_SHAPES ||
+                sscanf(optarg, "%dx%d", &shapes[num_shapes].M, &shapes[num_shapes].N) != 2 ||
+                shapes[num_shapes].M < 1 || shapes[num_shapes].M > TUNE_MAX_DIM ||
+                shapes[num_shapes].N < 1 || shapes[num_shapes].N > TUNE_MAX_DIM) {
+                printf("%s: Invalid matrix shape %s\n", argv[0], optarg);
+                exit(1);
+            }
+            num_shapes++;
+            break;
+        case 'o':
+            out_file = optarg;
+            break;
+        case 'v':
+            verbosity = 1;
+            break;
+        case 'h':
+            printUsage(argv);
+            exit(0);
+        default:
+            printUsage(argv);
+            exit(1);
+        }
+    }
+
+    if (tune_par.s == 0 || tune_par.E == 0 || tune_par.b == 0 || num_shapes == 0) {
+        printf("%s: Missing required command line argument\n", argv[0]);
+        printUsage(argv);
+        exit(1);
+    }
+    if ((policy = find_policy(policy_name)) == NULL || !policy_supports(policy, tune_par.E)) {
+        printf("%s: Policy %s can't manage %d lines per set\n", argv[0], policy_name, tune_par.E);
+        exit(1);
+    }
+
+    for (k = 0; k < num_shapes; k++) {
+        if (tune_shape(shapes[k].M, shapes[k].N, policy, &best[k]) < 0) {
+            printf("%s: Replay of %dx%d didn't transpose\n", argv[0], shapes[k].M, shapes[k].N);
+            exit(1);
+        }
+    }
+
+    if (out_file != NULL && (out = fopen(out_file, "w")) == NULL) {
+        printf("%s: Could not write %s\n", argv[0], out_file);
+        exit(1);
+    }
+    write_table(out, argc, argv, shapes, best, num_shapes);
+    if (out != stdout) {
+        fclose(out);
+    }
+    return 0;
+}